@@ -0,0 +1,259 @@
+// Bench.cpp : Benchmark mode for the shell, compiles a script once and runs
+// it repeatedly, reporting throughput, latency percentiles, GC pauses and
+// peak memory.
+//
+
+#include "stdafx.h"
+
+#include <v8.h>
+#include <math.h>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#if defined(_WIN32)
+#	include <windows.h>
+#	include <psapi.h>
+#	pragma comment(lib, "psapi.lib")
+#else
+#	include <sys/resource.h>
+#endif
+
+#include "V8Transmission.h"
+#include "Bench.h"
+
+using namespace v8;
+
+using namespace V8Transmission;
+
+
+Handle<v8::Context> CreateShellContext(v8::Isolate* isolate);
+Handle<String> ReadFile(v8::Isolate* isolate, const char* name);
+void ReportException(v8::Isolate* isolate, v8::TryCatch* handler);
+void PumpCompletions(v8::Isolate* isolate);
+
+
+using Timing::Clock;
+using Timing::ElapsedMs;
+using Timing::Percentile;
+
+
+// GC pauses during the timed runs, as GCPauses timed them.
+struct BenchPauses
+{
+	int count;
+	double total_ms;
+	double max_ms;
+};
+
+static BenchPauses gc_pauses;
+
+static void OnGC(v8::Isolate* isolate, v8::GCType type, uint64_t started, double pause)
+{
+	gc_pauses.count++;
+	gc_pauses.total_ms += pause;
+	gc_pauses.max_ms = std::max(gc_pauses.max_ms, pause);
+}
+
+
+// Peak resident set of the whole process so far, in bytes.
+static size_t PeakRSS()
+{
+#if defined(_WIN32)
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return counters.PeakWorkingSetSize;
+	return 0;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+#	if defined(__APPLE__)
+	return static_cast<size_t>(usage.ru_maxrss);
+#	else
+	return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#	endif
+#endif
+}
+
+
+// One run of the compiled script, in a fresh shell context, one leased from
+// the pool or the current one.
+static bool RunOnce(v8::Isolate* isolate, Handle<v8::UnboundScript> unbound, bool fresh_context, ContextPool* pool)
+{
+	HandleScope handle_scope(isolate);
+
+	ContextPool::Lease lease;
+	Handle<v8::Context> context;
+	if (pool != NULL) {
+		lease = pool->Acquire();
+		context = lease.Context();
+	}
+	else {
+		context = fresh_context ? CreateShellContext(isolate) : isolate->GetCurrentContext();
+	}
+	if (context.IsEmpty()) {
+		// Covers an invalid lease too, the pool couldn't build a context.
+		fprintf(stderr, "Error creating context\n");
+		return false;
+	}
+	v8::Context::Scope context_scope(context);
+
+	v8::TryCatch try_catch;
+	Handle<v8::Script> script = unbound->BindToCurrentContext();
+	Handle<Value> result = script->Run();
+	if (result.IsEmpty()) {
+		ReportException(isolate, &try_catch);
+		lease.Discard();
+		return false;
+	}
+
+	PumpCompletions(isolate);
+	return true;
+}
+
+
+// Runs by --bench N [--warmup M] [--fresh-context [--context-pool P]] [--json] <file>.
+int RunBench(v8::Isolate* isolate, const char* file, const BenchOptions& options) {
+	HandleScope handle_scope(isolate);
+
+	Handle<String> source_text = ReadFile(isolate, file);
+	if (source_text.IsEmpty()) {
+		fprintf(stderr, "Error reading '%s'\n", file);
+		return 1;
+	}
+
+	// Compiled once, every run only binds it to its context.
+	v8::TryCatch try_catch;
+	v8::ScriptCompiler::Source source(source_text, v8::ScriptOrigin(String::NewFromUtf8(isolate, file)));
+	Handle<v8::UnboundScript> unbound = v8::ScriptCompiler::CompileUnbound(isolate, &source);
+	if (unbound.IsEmpty()) {
+		ReportException(isolate, &try_catch);
+		return 1;
+	}
+
+	// Contexts are handed back and reset between runs, and the pool is topped
+	// up after each one, off the timed part.
+	std::unique_ptr<ContextPool> pool;
+	if (options.fresh_context && options.pool_size > 0) {
+		pool.reset(new ContextPool(isolate, CreateShellContext, options.pool_size));
+		pool->Fill();
+	}
+
+	for (int i = 0; i < options.warmup; i++) {
+		if (!RunOnce(isolate, unbound, options.fresh_context, pool.get())) return 1;
+		if (pool) pool->Maintain();
+	}
+	ContextPool::Stats warm_stats = pool ? pool->Statistics() : ContextPool::Stats();
+
+	gc_pauses = BenchPauses();
+	int gc_listener = GCPauses::ForIsolate(isolate).Add(isolate, OnGC);
+
+	std::vector<double> latencies;
+	latencies.reserve(options.iterations);
+	size_t peak_heap = 0;
+	bool failed = false;
+
+	Clock::time_point start = Clock::now();
+	for (int i = 0; i < options.iterations && !failed; i++) {
+		Clock::time_point before = Clock::now();
+		failed = !RunOnce(isolate, unbound, options.fresh_context, pool.get());
+		latencies.push_back(ElapsedMs(before, Clock::now()));
+		if (pool) pool->Maintain();
+
+		v8::HeapStatistics heap;
+		isolate->GetHeapStatistics(&heap);
+		peak_heap = std::max(peak_heap, heap.used_heap_size());
+	}
+	double total_ms = ElapsedMs(start, Clock::now());
+
+	GCPauses::ForIsolate(isolate).Remove(isolate, gc_listener);
+
+	if (failed) return 1;
+
+	v8::HeapStatistics heap;
+	isolate->GetHeapStatistics(&heap);
+
+	// Pool figures for the timed runs only.
+	ContextPool::Stats pool_stats;
+	if (pool) {
+		pool_stats.hits = pool->Statistics().hits - warm_stats.hits;
+		pool_stats.misses = pool->Statistics().misses - warm_stats.misses;
+		pool_stats.recycled = pool->Statistics().recycled - warm_stats.recycled;
+		pool_stats.discarded = pool->Statistics().discarded - warm_stats.discarded;
+	}
+
+	std::sort(latencies.begin(), latencies.end());
+	double ops = total_ms > 0 ? latencies.size() * 1000.0 / total_ms : 0;
+
+	if (options.json) {
+		JsonWriter json;
+		json.BeginObject();
+		json.Key("script");			json.String(file, strlen(file));
+		json.Key("iterations");		json.Integer(options.iterations);
+		json.Key("warmup");			json.Integer(options.warmup);
+		json.Key("freshContext");	json.Bool(options.fresh_context);
+		json.Key("totalMs");		json.Number(total_ms);
+		json.Key("opsPerSec");		json.Number(ops);
+		json.Key("latencyMs");
+		json.BeginObject();
+		json.Key("min");			json.Number(latencies.front());
+		json.Key("p50");			json.Number(Percentile(latencies, 0.50));
+		json.Key("p90");			json.Number(Percentile(latencies, 0.90));
+		json.Key("p99");			json.Number(Percentile(latencies, 0.99));
+		json.Key("p999");			json.Number(Percentile(latencies, 0.999));
+		json.Key("max");			json.Number(latencies.back());
+		json.EndObject();
+		json.Key("gc");
+		json.BeginObject();
+		json.Key("count");			json.Integer(gc_pauses.count);
+		json.Key("totalPauseMs");	json.Number(gc_pauses.total_ms);
+		json.Key("maxPauseMs");		json.Number(gc_pauses.max_ms);
+		json.EndObject();
+		json.Key("heap");
+		json.BeginObject();
+		json.Key("peakUsedBytes");	json.Unsigned(peak_heap);
+		json.Key("usedBytes");		json.Unsigned(heap.used_heap_size());
+		json.Key("totalBytes");		json.Unsigned(heap.total_heap_size());
+		json.Key("limitBytes");		json.Unsigned(heap.heap_size_limit());
+		json.EndObject();
+		json.Key("peakRssBytes");	json.Unsigned(PeakRSS());
+		if (pool) {
+			json.Key("contextPool");
+			json.BeginObject();
+			json.Key("size");		json.Integer(options.pool_size);
+			json.Key("hits");		json.Unsigned(pool_stats.hits);
+			json.Key("misses");		json.Unsigned(pool_stats.misses);
+			json.Key("recycled");	json.Unsigned(pool_stats.recycled);
+			json.Key("discarded");	json.Unsigned(pool_stats.discarded);
+			json.EndObject();
+		}
+		json.EndObject();
+
+		printf("%s\n", json.Buffer().c_str());
+	}
+	else {
+		printf("%s: %d runs (%d warmup) in %s\n", file, options.iterations, options.warmup,
+			pool ? "pooled contexts" : options.fresh_context ? "fresh contexts" : "one reused context");
+		printf("  throughput  %.1f ops/s (%.3f ms total)\n", ops, total_ms);
+		printf("  latency ms  p50 %.4f  p90 %.4f  p99 %.4f  p999 %.4f  max %.4f\n",
+			Percentile(latencies, 0.50), Percentile(latencies, 0.90), Percentile(latencies, 0.99),
+			Percentile(latencies, 0.999), latencies.back());
+		printf("  gc          %d pauses, %.3f ms total, %.3f ms max\n", gc_pauses.count, gc_pauses.total_ms, gc_pauses.max_ms);
+		printf("  heap        %.1f MB peak used, %.1f MB used, %.1f MB total\n",
+			peak_heap / 1048576.0, heap.used_heap_size() / 1048576.0, heap.total_heap_size() / 1048576.0);
+		printf("  peak rss    %.1f MB\n", PeakRSS() / 1048576.0);
+		if (pool) {
+			printf("  pool        %d contexts, %llu hits, %llu misses, %llu recycled, %llu discarded\n", options.pool_size,
+				static_cast<unsigned long long>(pool_stats.hits), static_cast<unsigned long long>(pool_stats.misses),
+				static_cast<unsigned long long>(pool_stats.recycled), static_cast<unsigned long long>(pool_stats.discarded));
+		}
+	}
+	fflush(stdout);
+
+	return 0;
+}
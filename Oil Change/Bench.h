@@ -0,0 +1,21 @@
+// Bench.h : Benchmark mode for the shell, see RunBench.
+//
+
+#pragma once
+
+#include <v8.h>
+
+
+struct BenchOptions
+{
+	int iterations;			// --bench N, timed runs (0 runs scripts once as usual)
+	int warmup;				// --warmup M, untimed runs before the timed ones
+	bool fresh_context;		// --fresh-context, a new shell context for every run
+	int pool_size;			// --context-pool N, fresh contexts come from a ContextPool of N
+	bool json;				// --json, report as JSON instead of text
+
+	BenchOptions() : iterations(0), warmup(0), fresh_context(false), pool_size(0), json(false) {}
+};
+
+
+int RunBench(v8::Isolate* isolate, const char* file, const BenchOptions& options);
@@ -0,0 +1,248 @@
+// HeapPolicy.cpp : Host side GC scheduling for the shell, see HeapPolicy.h.
+//
+// Major GCs used to land in the middle of jobs, this moves as much of that
+// work as V8 will take into the gaps between them (IdleNotification), keeps
+// the heap inside configured limits, stops a script that is about to run the
+// isolate out of memory instead of letting V8 abort, and forwards the host's
+// own memory pressure. Pauses are recorded per GC type for --gc-stats.
+
+#include "stdafx.h"
+
+#include <v8.h>
+#include <chrono>
+#include <atomic>
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <signal.h>
+#endif
+
+#include "V8Transmission.h"
+#include "HeapPolicy.h"
+
+using namespace V8Transmission;
+
+using Timing::Clock;
+using Timing::ElapsedMs;
+
+static HeapOptions heap_options;
+
+// Pauses as GCPauses timed them.
+struct PauseLog
+{
+	std::vector<double> scavenge_ms;
+	std::vector<double> mark_sweep_ms;
+};
+
+static PauseLog pauses;
+
+// Idle time offered, and how much of it went into GC.
+static int idle_rounds;
+static double idle_used_ms;
+
+static bool shedding;
+static std::atomic<bool> shed_pending(false);
+static int sheds;
+
+// 0 none, 1 moderate, 2 critical. Set from a signal handler or polled from the
+// OS, so it only ever gets stored to.
+static std::atomic<int> host_pressure(0);
+static int pressure_notifications;
+
+#if defined(_WIN32)
+static HANDLE low_memory = NULL;
+#endif
+
+
+void ParseHeapOptions(int argc, char* argv[], HeapOptions& options) {
+	for (int i = 1; i < argc; i++) {
+		const char* str = argv[i];
+		if (strcmp(str, "--max-old-mb") == 0 && i + 1 < argc) {
+			options.max_old_mb = atoi(argv[++i]);
+		}
+		else if (strcmp(str, "--max-young-mb") == 0 && i + 1 < argc) {
+			options.max_young_mb = atoi(argv[++i]);
+		}
+		else if (strcmp(str, "--idle-gc-ms") == 0 && i + 1 < argc) {
+			options.idle_gc_ms = atoi(argv[++i]);
+		}
+		else if (strcmp(str, "--shed-at") == 0 && i + 1 < argc) {
+			options.shed_percent = std::max(10, std::min(100, atoi(argv[++i])));
+		}
+		else if (strcmp(str, "--gc-stats") == 0) {
+			options.gc_stats = true;
+		}
+	}
+	heap_options = options;
+}
+
+
+void ApplyHeapLimits(v8::Isolate* isolate, const HeapOptions& options) {
+	if (options.max_old_mb <= 0 && options.max_young_mb <= 0) return;
+
+	v8::ResourceConstraints constraints;
+	if (options.max_old_mb > 0) constraints.set_max_old_space_size(options.max_old_mb);
+	if (options.max_young_mb > 0) constraints.set_max_young_space_size(options.max_young_mb);
+
+	// Newer V8 only takes constraints through Isolate::CreateParams, the shell
+	// runs on the default isolate so this is the form it can use.
+	v8::SetResourceConstraints(isolate, &constraints);
+}
+
+
+static bool NearHeapLimit(v8::Isolate* isolate) {
+	v8::HeapStatistics stats;
+	isolate->GetHeapStatistics(&stats);
+	if (heap_options.shed_percent == 0 || stats.heap_size_limit() == 0) return false;
+	return stats.used_heap_size() * 100 >= stats.heap_size_limit() * static_cast<size_t>(heap_options.shed_percent);
+}
+
+
+// Stops whatever is running before it takes the heap past its limit, V8 would
+// otherwise abort the process. The host refuses further jobs until a full GC
+// brings the heap back down, see ShouldShedLoad.
+static void ShedLoad(v8::Isolate* isolate) {
+	if (!shedding) sheds++;
+	shedding = true;
+	shed_pending = true;
+	isolate->TerminateExecution();
+}
+
+
+static void OnGC(v8::Isolate* isolate, v8::GCType type, uint64_t started, double pause) {
+	if (type == v8::kGCTypeScavenge)
+		pauses.scavenge_ms.push_back(pause);
+	else
+		pauses.mark_sweep_ms.push_back(pause);
+
+#if !V8T_V8_AT_LEAST(6, 7)
+	// Without a near heap limit callback the best place to notice is right
+	// after a full GC, when what is still used is actually live.
+	if (type != v8::kGCTypeScavenge && NearHeapLimit(isolate)) ShedLoad(isolate);
+#endif
+}
+
+
+#if V8T_V8_AT_LEAST(6, 7)
+// Gives the heap a quarter more room, enough for the terminated script to
+// unwind.
+static size_t OnNearHeapLimit(void* data, size_t current_heap_limit, size_t initial_heap_limit) {
+	v8::Isolate* isolate = static_cast<v8::Isolate*>(data);
+	ShedLoad(isolate);
+	return current_heap_limit + current_heap_limit / 4;
+}
+#endif
+
+
+#if !defined(_WIN32)
+// SIGUSR1 reports moderate pressure and SIGUSR2 critical, e.g. from a cgroup
+// memory watcher. Only stores the level, HostIdle passes it on.
+static void OnPressureSignal(int signal) {
+	host_pressure = signal == SIGUSR2 ? 2 : 1;
+}
+#endif
+
+
+void InstallHeapPolicy(v8::Isolate* isolate, const HeapOptions& options) {
+	heap_options = options;
+	GCPauses::ForIsolate(isolate).Add(isolate, OnGC);
+#if V8T_V8_AT_LEAST(6, 7)
+	if (options.shed_percent > 0) isolate->AddNearHeapLimitCallback(OnNearHeapLimit, isolate);
+#endif
+
+#if defined(_WIN32)
+	low_memory = CreateMemoryResourceNotification(LowMemoryResourceNotification);
+#else
+	signal(SIGUSR1, OnPressureSignal);
+	signal(SIGUSR2, OnPressureSignal);
+#endif
+}
+
+
+static void ForwardMemoryPressure(v8::Isolate* isolate) {
+#if defined(_WIN32)
+	BOOL low = FALSE;
+	if (low_memory != NULL && QueryMemoryResourceNotification(low_memory, &low) && low) host_pressure = 2;
+#endif
+
+	int level = host_pressure.exchange(0);
+	if (level == 0) return;
+	pressure_notifications++;
+
+#if V8T_V8_AT_LEAST(5, 3)
+	isolate->MemoryPressureNotification(level == 2 ? v8::MemoryPressureLevel::kCritical : v8::MemoryPressureLevel::kModerate);
+#else
+	// Older V8 only has the all or nothing form, moderate pressure gets an
+	// idle round instead.
+	if (level == 2)
+		v8::V8::LowMemoryNotification();
+	else
+		v8::V8::IdleNotification(std::max(heap_options.idle_gc_ms, 10));
+#endif
+}
+
+
+void HostIdle(v8::Isolate* isolate) {
+	ForwardMemoryPressure(isolate);
+	if (heap_options.idle_gc_ms <= 0) return;
+
+	Clock::time_point started = Clock::now();
+	idle_rounds++;
+#if V8T_V8_AT_LEAST(3, 28)
+	isolate->IdleNotification(heap_options.idle_gc_ms);
+#else
+	v8::V8::IdleNotification(heap_options.idle_gc_ms);
+#endif
+	idle_used_ms += ElapsedMs(started, Clock::now());
+}
+
+
+bool ShouldShedLoad(v8::Isolate* isolate) {
+	if (!shedding) return false;
+
+#if V8T_V8_AT_LEAST(3, 28)
+	isolate->LowMemoryNotification();
+#else
+	v8::V8::LowMemoryNotification();
+#endif
+	shedding = NearHeapLimit(isolate);
+	return shedding;
+}
+
+
+bool TakeLoadShed() {
+	return shed_pending.exchange(false);
+}
+
+
+static void PrintPauses(const char* kind, std::vector<double> samples) {
+	double total = 0;
+	for (size_t i = 0; i < samples.size(); i++) total += samples[i];
+	std::sort(samples.begin(), samples.end());
+	fprintf(stderr, "  %-11s %6d pauses, %9.3f ms total, p50 %.3f p90 %.3f p99 %.3f max %.3f ms\n",
+		kind, static_cast<int>(samples.size()), total,
+		Timing::Percentile(samples, 0.50), Timing::Percentile(samples, 0.90),
+		Timing::Percentile(samples, 0.99), Timing::Percentile(samples, 1.0));
+}
+
+
+void ReportHeapPolicy(v8::Isolate* isolate) {
+	if (!heap_options.gc_stats) return;
+
+	v8::HeapStatistics stats;
+	isolate->GetHeapStatistics(&stats);
+
+	fprintf(stderr, "GC pauses:\n");
+	PrintPauses("scavenge", pauses.scavenge_ms);
+	PrintPauses("mark-sweep", pauses.mark_sweep_ms);
+	fprintf(stderr, "  idle        %d rounds, %.3f ms given to GC\n", idle_rounds, idle_used_ms);
+	fprintf(stderr, "  pressure    %d notifications, %d scripts stopped near the heap limit\n", pressure_notifications, sheds);
+	fprintf(stderr, "  heap        %.1f of %.1f MB used\n",
+		stats.used_heap_size() / (1024.0 * 1024.0), stats.heap_size_limit() / (1024.0 * 1024.0));
+}
@@ -0,0 +1,44 @@
+// HeapPolicy.h : Host side GC scheduling for the shell, see InstallHeapPolicy.
+//
+
+#pragma once
+
+#include <v8.h>
+
+
+struct HeapOptions
+{
+	int max_old_mb;			// --max-old-mb N, old generation limit through ResourceConstraints
+	int max_young_mb;		// --max-young-mb N, young generation limit
+	int idle_gc_ms;			// --idle-gc-ms N, idle time offered to V8 between jobs (0 never)
+	int shed_percent;		// --shed-at P, stop the running script at P% of the heap limit (0 never)
+	bool gc_stats;			// --gc-stats, print the GC pause distribution at exit
+
+	HeapOptions() : max_old_mb(0), max_young_mb(0), idle_gc_ms(0), shed_percent(0), gc_stats(false) {}
+};
+
+
+// Picks the heap flags out of the command line. They have to be known before
+// the first context exists, RunMain only skips over them.
+void ParseHeapOptions(int argc, char* argv[], HeapOptions& options);
+
+// Heap limits for the isolate, before it has created any context.
+void ApplyHeapLimits(v8::Isolate* isolate, const HeapOptions& options);
+
+// GC pause recording, the near heap limit handling and the host memory
+// pressure watch.
+void InstallHeapPolicy(v8::Isolate* isolate, const HeapOptions& options);
+
+// Call between jobs, hands V8 the idle budget for GC work and forwards any
+// memory pressure the host signalled since the last call.
+void HostIdle(v8::Isolate* isolate);
+
+// True while the heap is too close to its limit to take on another job. A
+// full GC is tried first, the next job only runs if that freed enough.
+bool ShouldShedLoad(v8::Isolate* isolate);
+
+// True once since the last call if the running script was stopped to keep
+// the heap under its limit, to tell that apart from other terminations.
+bool TakeLoadShed();
+
+void ReportHeapPolicy(v8::Isolate* isolate);
@@ -6,12 +6,21 @@
 #include <v8.h>
 #include <assert.h>
 #include <fcntl.h>
+#include <math.h>
+#include <chrono>
+#include <memory>
 #include <string>
+#include <thread>
+#include <vector>
 #include <stdio.h>
 #include <stdlib.h>
 #include <iostream>
 
 #include "V8Transmission.h"
+#include "Bench.h"
+#include "HeapPolicy.h"
+#include "ScriptCache.h"
+#include "StreamingCompile.h"
 
 using namespace v8;
 
@@ -23,6 +32,8 @@ using namespace V8Transmission::TypeConversion::Internal;
 Handle<v8::Context> CreateShellContext(v8::Isolate* isolate);
 void RunShell(Handle<v8::Context> context);
 int RunMain(v8::Isolate* isolate, int argc, char* argv[]);
+bool RunFiles(v8::Isolate* isolate, char* files[], int count);
+Handle<Value> RunWithDeadline(v8::Isolate* isolate, Handle<v8::Script> script, bool* terminated);
 bool ExecuteString(v8::Isolate* isolate,
 	Handle<String> source,
 	Handle<Value> name,
@@ -35,6 +46,10 @@ void Quit(const v8::FunctionCallbackInfo<Value>& args);
 void Version(const v8::FunctionCallbackInfo<Value>& args);
 Handle<String> ReadFile(v8::Isolate* isolate, const char* name);
 void ReportException(v8::Isolate* isolate, v8::TryCatch* handler);
+void PumpCompletions(v8::Isolate* isolate);
+int RunStartupBench();
+
+extern EventChannel<double> sensorEvents;
 
 
 void BindDouble(const v8::FunctionCallbackInfo<Value>& args)
@@ -44,12 +59,31 @@ void BindDouble(const v8::FunctionCallbackInfo<Value>& args)
 
 
 static bool run_shell;
+static BenchOptions bench_options;
+static int timeout_ms;			// --timeout-ms, hard limit on each top level script
+static int soft_timeout_ms;		// --soft-timeout-ms, when deadlineExceeded() turns true
+static bool shed_last_run;		// the last script was stopped near the heap limit
+static uint32_t trace_categories = Trace::All;	// --trace-categories, what --trace-out records
+static bool tracing;			// --trace-out opened its file
+static const char* cpu_profile_path;	// --cpu-profile, .cpuprofile written at exit, collapsed stacks beside it
+static int cpu_profile_interval_us = CpuProfileSession::DefaultInterval;	// --cpu-profile-interval-us
 
 int main(int argc, char* argv[]) 
 {
 	v8::V8::InitializeICU();
 	v8::V8::SetFlagsFromCommandLine(&argc, argv, true);
+	HeapOptions heap_options;
+	ParseHeapOptions(argc, argv, heap_options);
 	v8::Isolate* isolate = v8::Isolate::GetCurrent();
+	ApplyHeapLimits(isolate, heap_options);
+	InstallHeapPolicy(isolate, heap_options);
+	for (int i = 1; i + 1 < argc; i++) {
+		// Needed before RunMain so the profile covers every script it runs.
+		if (strcmp(argv[i], "--cpu-profile") == 0)
+			cpu_profile_path = argv[++i];
+		else if (strcmp(argv[i], "--cpu-profile-interval-us") == 0)
+			cpu_profile_interval_us = atoi(argv[++i]);
+	}
 	run_shell = (argc == 1);
 	int result;
 	{
@@ -63,10 +97,47 @@ int main(int argc, char* argv[])
 
 // 		Handle<Value> stval = ConvertToJS(isolate, std::string("Hurr, Durr"));
 
+		std::unique_ptr<CpuProfileSession> profile;
+		if (cpu_profile_path != NULL) {
+			profile.reset(new CpuProfileSession(isolate, cpu_profile_interval_us));
+			profile->Start("Oil Change");
+		}
+
 		result = RunMain(isolate, argc, argv);
+		PumpCompletions(isolate);
 		if (run_shell) RunShell(context);
 
+		if (profile) {
+			std::string collapsed_path = CpuProfileSession::CollapsedPath(cpu_profile_path);
+			if (profile->Stop(cpu_profile_path, collapsed_path.c_str()))
+				fprintf(stderr, "CPU profile written to %s and %s\n", cpu_profile_path, collapsed_path.c_str());
+			else
+				fprintf(stderr, "Error writing CPU profile to %s\n", cpu_profile_path);
+		}
+
+		if (timeout_ms > 0 || soft_timeout_ms > 0) {
+			DeadlineStats& deadlines = DeadlineStats::ForIsolate(isolate);
+			fprintf(stderr, "Deadlines: %llu executions, %llu soft stops, %llu terminated\n",
+				static_cast<unsigned long long>(deadlines.executions.load()),
+				static_cast<unsigned long long>(deadlines.softStops.load()),
+				static_cast<unsigned long long>(deadlines.hardStops.load()));
+		}
+		ReportHeapPolicy(isolate);
+
+		if (tracing) {
+			Tracer::RemoveGCHooks(isolate);
+			Tracer::Shared().Stop();
+			if (Tracer::Shared().Dropped() > 0)
+				fprintf(stderr, "Trace: %llu events dropped\n", static_cast<unsigned long long>(Tracer::Shared().Dropped()));
+		}
+
+		// A global, it would otherwise let go of its handles after the isolate is gone.
+		sensorEvents.Close();
+
 		context->Exit();
+
+		// Frees the per-isolate state, the completion queue among it.
+		IsolateData::Dispose(isolate);
 	}
 	v8::V8::Dispose();
 	return result;
@@ -93,11 +164,97 @@ int xcx(std::string first, std::string second)
 	return 0;
 }
 
+// Deliberately slow FNV-1a over the input, stands in for compression/hashing
+// work that would otherwise stall the isolate.
+uint32_t SlowChecksum(std::string data)
+{
+	uint32_t hash = 2166136261u;
+
+	for (int round = 0; round < 1000; round++)
+	{
+		for (size_t i = 0; i < data.size(); i++)
+		{
+			hash ^= static_cast<unsigned char>(data[i]);
+			hash *= 16777619u;
+		}
+	}
+
+	return hash;
+}
+
+// Calls back into the script once per index, the predicate runs without its
+// own TryCatch so a throw surfaces in the calling script as usual.
+int CountWhere(int limit, JSCallback<bool(int)> predicate)
+{
+	if (!predicate) return 0;
+
+	predicate.SetCatchExceptions(false);
+
+	int count = 0;
+	for (int i = 0; i < limit; i++)
+	{
+		if (predicate(i)) count++;
+		if (predicate.Threw()) break;
+	}
+
+	return count;
+}
+
+// The first limit naturals, produced only as far as the script iterates, so
+// "for (var n of naturals(1e9)) if (n > 10) break;" stops after eleven.
+JSIterable Naturals(int limit)
+{
+	int next = 0;
+	return JSIterable::Generate<int>([limit, next](int& out) mutable { out = next++; return out < limit; });
+}
+
+// Narrows or widens what an open --trace-out file records from here on, e.g.
+// traceCategories("gc") around a block of interest, "" pauses recording.
+int TraceCategories(std::string list)
+{
+	Tracer::Shared().SetCategories(Trace::ParseCategories(list.c_str()));
+	return static_cast<int>(Tracer::Shared().Categories());
+}
+
+EventChannel<double> sensorEvents;
+
+// Pushes readings from a thread of its own, the script sees them in batches as
+// a Float64Array through whatever it handed to onSensor. The producer counts as
+// an operation in flight so the shell keeps pumping until it is done.
+int StartSensor(int count)
+{
+	std::shared_ptr<CompletionQueue> queue = CompletionQueue::Share(v8::Isolate::GetCurrent());
+	queue->BeginOperation();
+
+	std::thread([count, queue]() {
+		for (int i = 0; i < count; i++)
+			sensorEvents.Push(sin(i * 0.01));
+
+		queue->Post([](v8::Isolate*) {});
+	}).detach();
+
+	return count;
+}
+
+#if V8T_ENABLE_COROUTINES
+// Two dependent native steps that never block the isolate, each co_await hands
+// the work to the pool and picks up again on this thread once it completes.
+JSTask<uint32_t> ChecksumPipeline(std::string data)
+{
+	uint32_t first = co_await OffloadToPool([data]() { return SlowChecksum(data); });
+	uint32_t second = co_await OffloadToPool([data, first]() { return SlowChecksum(data + std::to_string(first)); });
+
+	co_return second;
+}
+#endif
+
 
 class RandomCrap
 {
 public:
 	std::string vx = "VX String";
+	std::vector<double> samples = std::vector<double>(1024);
+	std::vector<std::string> tags = std::vector<std::string>(4, "untagged");
 
 	RandomCrap(){}
 
@@ -109,19 +266,36 @@ public:
 	}
 };
 
-namespace V8Transmission
+struct Greeting
 {
-	namespace TypeConversion
-	{
-		template<>
-		struct ShiftNative<RandomCrap*>
-		{
-			RandomCrap* operator()(v8::Isolate* iso, const v8::Handle<v8::Value>& val) const
-			{
-				return new RandomCrap;
-			}
-		};
-	}
+	std::string text;
+	std::string to;
+};
+
+V8T_REFLECT_STRUCT(Greeting,
+	V8T_FIELD(text)
+	V8T_FIELD(to))
+
+int MaxGreetingLength = 256;
+int GreetingCount = 0;
+
+Greeting Greet(std::string who)
+{
+	if (who.size() > static_cast<size_t>(MaxGreetingLength))
+		who.resize(MaxGreetingLength);
+
+	Greeting greeting;
+	greeting.text = "Hello, " + who;
+	greeting.to = who;
+
+	StaticVariableGear<int, &GreetingCount>::Set(GreetingCount + 1);
+
+	return greeting;
+}
+
+JsonText<Greeting> GreetJSON(std::string who)
+{
+	return Greet(who);
 }
 
 template <>
@@ -136,6 +310,130 @@ struct CO_Identifier<RandomCrap>
 };
 //CO_Identifier<RandomCrap>::Value = "RandomCrap";
 
+namespace V8Transmission
+{
+	// Shows up in census() so live RandomCrap wrappers can be watched from scripts.
+	template <>
+	struct CO_EnableCensus<RandomCrap> : Boolean_Option<true> {};
+
+	template <>
+	struct ClassMembers<RandomCrap>
+	{
+		static void Bind(v8::Isolate* isolate)
+		{
+			MemberFunctionGear<RandomCrap, int, std::string>::Bind<&RandomCrap::XPrint>(isolate, "xPrint");
+			MemberVariableGear<RandomCrap, std::string, &RandomCrap::vx>::BindRW(isolate, "vx");
+			// samples is never resized, so a TypedArray over it can't dangle.
+			MemberArrayViewGear<RandomCrap, std::vector<double>, &RandomCrap::samples, true>::Bind(isolate, "samples");
+			MemberArrayViewGear<RandomCrap, std::vector<std::string>, &RandomCrap::tags>::Bind(isolate, "tags");
+		}
+	};
+}
+
+V8T_REGISTER_CLASS(RandomCrap)
+
+// Small and trivially destructible, so "new Point(x, y)" constructs straight
+// into a pooled slot with its arguments instead of a default object plus an
+// init call.
+struct Point
+{
+	double x, y;
+
+	Point() : x(0), y(0) {}
+	Point(double x, double y) : x(x), y(y) {}
+
+	double Length() { return sqrt(x * x + y * y); }
+};
+
+namespace V8Transmission
+{
+	template <>
+	struct CO_Identifier<Point>
+	{
+		static std::string* Value()
+		{
+			static std::string* id = new std::string("Point");
+
+			return id;
+		}
+	};
+
+	template <>
+	struct CO_Constructors<Point>
+	{
+		typedef ConstructorOverloads<ConstructorGear<Point>, ConstructorGear<Point, double, double> > Type;
+	};
+
+	template <>
+	struct CO_InlineStorage<Point> : Boolean_Option<true> {};
+
+	template <>
+	struct CO_EnableSmartPointerGC<Point> : Boolean_Option<true> {};
+
+	template <>
+	struct ClassMembers<Point>
+	{
+		static void Bind(v8::Isolate* isolate)
+		{
+			MemberFunctionGear<Point, double>::Bind<&Point::Length>(isolate, "length");
+			MemberVariableGear<Point, double, &Point::x>::BindRW(isolate, "x");
+			MemberVariableGear<Point, double, &Point::y>::BindRW(isolate, "y");
+		}
+	};
+}
+
+V8T_REGISTER_CLASS(Point)
+
+// Inherits length(), x and y from Point's prototype rather than binding its own
+// copies, they see the Point inside a LabeledPoint through the class hierarchy.
+struct LabeledPoint : Point
+{
+	std::string label;
+
+	LabeledPoint() {}
+	LabeledPoint(double x, double y, std::string label) : Point(x, y), label(label) {}
+};
+
+namespace V8Transmission
+{
+	template <>
+	struct CO_Identifier<LabeledPoint>
+	{
+		static std::string* Value()
+		{
+			static std::string* id = new std::string("LabeledPoint");
+
+			return id;
+		}
+	};
+
+	template <>
+	struct CO_BaseClass<LabeledPoint>
+	{
+		typedef Point Type;
+	};
+
+	template <>
+	struct CO_Constructors<LabeledPoint>
+	{
+		typedef ConstructorOverloads<ConstructorGear<LabeledPoint>, ConstructorGear<LabeledPoint, double, double, std::string> > Type;
+	};
+
+	template <>
+	struct CO_EnableSmartPointerGC<LabeledPoint> : Boolean_Option<true> {};
+
+	template <>
+	struct ClassMembers<LabeledPoint>
+	{
+		static void Bind(v8::Isolate* isolate)
+		{
+			MemberVariableGear<LabeledPoint, std::string, &LabeledPoint::label>::BindRW(isolate, "label");
+		}
+	};
+}
+
+V8T_REGISTER_CLASS(LabeledPoint)
+
 
 // Creates a new execution environment containing the built-in
 // functions.
@@ -148,18 +446,33 @@ Handle<v8::Context> CreateShellContext(v8::Isolate* isolate) {
 	global->Set(String::NewFromUtf8(isolate, "load"), FunctionTemplate::New(isolate, Load));
 	global->Set(String::NewFromUtf8(isolate, "quit"), FunctionTemplate::New(isolate, Quit)); 
 	global->Set(String::NewFromUtf8(isolate, "version"), FunctionTemplate::New(isolate, Version));
+	global->Set(String::NewFromUtf8(isolate, "census"), FunctionTemplate::New(isolate, Census::Query));
+	global->Set(String::NewFromUtf8(isolate, "deadlineExceeded"), FunctionTemplate::New(isolate, ExecutionDeadline::Check));
 
 	global->Set(String::NewFromUtf8(isolate, "dblValue"), FunctionTemplate::New(isolate, BindDouble));
 
 
-	typedef ClassGear<RandomCrap> CGRC;
-	CGRC::Initialize(isolate);
-	MemberFunctionGear<RandomCrap, int, std::string>::Bind<&RandomCrap::XPrint>(isolate, "xPrint");
-	MemberVariableGear<RandomCrap, std::string, &RandomCrap::vx>::BindRW(isolate, "vx");
-	CGRC::Bind(isolate, global);
+	// Registered classes (RandomCrap so far) only get their templates built once a script uses them.
+	ClassRegistry::Shared().Bind(isolate, global);
 
-	global->Set(String::NewFromUtf8(isolate, "gear"), FunctionTemplate::New(isolate, StaticFunctionGear<int, std::string, std::string>::Invoke<xc>));
-	global->Set(String::NewFromUtf8(isolate, "gearx"), FunctionTemplate::New(isolate, StaticFunctionGear<int, std::string, std::string>::Invoke<xcx>));
+	StaticFunctionGear<int, std::string, std::string>::Bind<xc>(isolate, global, "gear");
+	StaticFunctionGear<int, std::string, std::string>::Bind<xcx>(isolate, global, "gearx");
+
+	StaticFunctionGear<Greeting, std::string>::Bind<Greet>(isolate, global, "greet");
+	StaticFunctionGear<int, int, JSCallback<bool(int)> >::Bind<CountWhere>(isolate, global, "countWhere");
+	StaticFunctionGear<JSIterable, int>::Bind<Naturals>(isolate, global, "naturals");
+	global->Set(String::NewFromUtf8(isolate, "onSensor"), sensorEvents.SubscribeTemplate(isolate));
+	sensorEvents.SetErrorReporter([](v8::Isolate* isolate, v8::TryCatch& try_catch) { ReportException(isolate, &try_catch); });
+	StaticFunctionGear<int, int>::Bind<StartSensor>(isolate, global, "startSensor");
+	StaticFunctionGear<int, std::string>::Bind<TraceCategories>(isolate, global, "traceCategories");
+	StaticFunctionGear<JsonText<Greeting>, std::string>::Bind<GreetJSON>(isolate, global, "greetJSON");
+	StaticVariableGear<int, &MaxGreetingLength>::BindConstant(isolate, global, "MAX_GREETING_LENGTH");
+	StaticVariableGear<int, &GreetingCount>::BindRO(isolate, global, "greetingCount");
+
+	AsyncFunctionGear<uint32_t, std::string>::Bind<SlowChecksum>(isolate, global, "checksumAsync");
+#if V8T_ENABLE_COROUTINES
+	StaticFunctionGear<JSTask<uint32_t>, std::string>::Bind<ChecksumPipeline>(isolate, global, "checksumPipeline");
+#endif
 
 
 	return v8::Context::New(isolate, NULL, global);
@@ -216,8 +529,10 @@ void Read(const v8::FunctionCallbackInfo<Value>& args) {
 
 // The callback that is invoked by v8 whenever the JavaScript 'load'
 // function is called.  Loads, compiles and executes its argument
-// JavaScript file.
+// JavaScript file.  Compiled scripts are kept in the ScriptCache, so loading
+// an unchanged file again only stats it and binds it to the context.
 void Load(const v8::FunctionCallbackInfo<Value>& args) {
+	ScriptCache& cache = ScriptCache::ForIsolate(args.GetIsolate());
 	for (int i = 0; i < args.Length(); i++) {
 		HandleScope handle_scope(args.GetIsolate());
 		String::Utf8Value file(args[i]);
@@ -226,17 +541,20 @@ void Load(const v8::FunctionCallbackInfo<Value>& args) {
 				String::NewFromUtf8(args.GetIsolate(), "Error loading file"));
 			return;
 		}
-		Handle<String> source = ReadFile(args.GetIsolate(), *file);
-		if (source.IsEmpty()) {
+		bool read, ran;
+		{
+			// Only a script's own failure is caught here, a missing file throws nothing.
+			v8::TryCatch try_catch;
+			Handle<v8::Script> script = cache.Get(args.GetIsolate(), *file);
+			read = !script.IsEmpty() || try_catch.HasCaught();
+			ran = !script.IsEmpty() && !script->Run().IsEmpty();
+		}
+		if (!read) {
 			args.GetIsolate()->ThrowException(
 				String::NewFromUtf8(args.GetIsolate(), "Error loading file"));
 			return;
 		}
-		if (!ExecuteString(args.GetIsolate(),
-			source,
-			String::NewFromUtf8(args.GetIsolate(), *file),
-			false,
-			false)) {
+		if (!ran) {
 			args.GetIsolate()->ThrowException(
 				String::NewFromUtf8(args.GetIsolate(), "Error executing file"));
 			return;
@@ -265,6 +583,7 @@ void Version(const v8::FunctionCallbackInfo<Value>& args) {
 
 // Reads a file into a v8 string.
 Handle<String> ReadFile(v8::Isolate* isolate, const char* name) {
+	V8T_TRACE_SCOPE(Trace::IO, "ReadFile");
 	FILE* file = fopen(name, "rb");
 	if (file == NULL) return Handle<String>();
 
@@ -293,6 +612,62 @@ int RunMain(v8::Isolate* isolate, int argc, char* argv[]) {
 		if (strcmp(str, "--shell") == 0) {
 			run_shell = true;
 		}
+		else if (strcmp(str, "--startup-bench") == 0) {
+			// Context startup with 10/100/1000 classes, eager against lazy.
+			if (RunStartupBench() != 0) return 1;
+		}
+		else if (strcmp(str, "--bench") == 0 && i + 1 < argc) {
+			// Scripts after this are run N times and measured instead of run once.
+			bench_options.iterations = atoi(argv[++i]);
+		}
+		else if (strcmp(str, "--warmup") == 0 && i + 1 < argc) {
+			bench_options.warmup = atoi(argv[++i]);
+		}
+		else if (strcmp(str, "--fresh-context") == 0) {
+			bench_options.fresh_context = true;
+		}
+		else if (strcmp(str, "--context-pool") == 0 && i + 1 < argc) {
+			bench_options.fresh_context = true;
+			bench_options.pool_size = atoi(argv[++i]);
+		}
+		else if (strcmp(str, "--json") == 0) {
+			bench_options.json = true;
+		}
+		else if (strcmp(str, "--timeout-ms") == 0 && i + 1 < argc) {
+			timeout_ms = atoi(argv[++i]);
+		}
+		else if (strcmp(str, "--soft-timeout-ms") == 0 && i + 1 < argc) {
+			soft_timeout_ms = atoi(argv[++i]);
+		}
+		else if (strcmp(str, "--script-cache-mb") == 0 && i + 1 < argc) {
+			// Memory bound on the sources load() keeps compiled.
+			ScriptCache::ForIsolate(isolate).SetLimit(static_cast<size_t>(atoi(argv[++i])) * 1024 * 1024);
+		}
+		else if ((strcmp(str, "--max-old-mb") == 0 || strcmp(str, "--max-young-mb") == 0 ||
+			strcmp(str, "--idle-gc-ms") == 0 || strcmp(str, "--shed-at") == 0) && i + 1 < argc) {
+			// Already taken before the context was made, see ParseHeapOptions.
+			i++;
+		}
+		else if (strcmp(str, "--gc-stats") == 0) {
+			continue;
+		}
+		else if ((strcmp(str, "--cpu-profile") == 0 || strcmp(str, "--cpu-profile-interval-us") == 0) && i + 1 < argc) {
+			// Already taken in main, the profile has to be running first.
+			i++;
+		}
+		else if (strcmp(str, "--trace-categories") == 0 && i + 1 < argc) {
+			trace_categories = Trace::ParseCategories(argv[++i]);
+			Tracer::Shared().SetCategories(trace_categories);
+		}
+		else if (strcmp(str, "--trace-out") == 0 && i + 1 < argc) {
+			// Chrome trace event JSON, open it in chrome://tracing or Perfetto.
+			const char* path = argv[++i];
+			tracing = Tracer::Shared().Start(path, trace_categories);
+			if (tracing)
+				Tracer::InstallGCHooks(isolate);
+			else
+				fprintf(stderr, "Error opening trace file '%s'\n", path);
+		}
 		else if (strcmp(str, "-f") == 0) {
 			// Ignore any -f flags for compatibility with the other stand-
 			// alone JavaScript engines.
@@ -302,6 +677,11 @@ int RunMain(v8::Isolate* isolate, int argc, char* argv[]) {
 			fprintf(stderr,
 				"Warning: unknown flag %s.\nTry --help for options\n", str);
 		}
+		else if (ShouldShedLoad(isolate)) {
+			// Still too close to the heap limit after a full GC, drop the job.
+			fprintf(stderr, "Skipping %s: heap near its limit\n", str);
+			if (strcmp(str, "-e") == 0) i++;
+		}
 		else if (strcmp(str, "-e") == 0 && i + 1 < argc) {
 			// Execute argument given to -e option directly.
 			Handle<String> file_name =
@@ -309,22 +689,96 @@ int RunMain(v8::Isolate* isolate, int argc, char* argv[]) {
 			Handle<String> source =
 				String::NewFromUtf8(isolate, argv[++i]);
 			if (!ExecuteString(isolate, source, file_name, false, true)) return 1;
+			HostIdle(isolate);
+		}
+		else if (bench_options.iterations > 0) {
+			if (RunBench(isolate, str, bench_options) != 0) return 1;
+			HostIdle(isolate);
 		}
 		else {
-			// Use all other arguments as names of files to load and run.
-			Handle<String> file_name = String::NewFromUtf8(isolate, str);
-			Handle<String> source = ReadFile(isolate, str);
-			if (source.IsEmpty()) {
-				fprintf(stderr, "Error reading '%s'\n", str);
-				continue;
-			}
-			if (!ExecuteString(isolate, source, file_name, false, true)) return 1;
+			// Use all other arguments as names of files to load and run,
+			// consecutive ones are read and parsed concurrently.
+			int count = 1;
+			while (i + count < argc && argv[i + count][0] != '-') count++;
+			if (!RunFiles(isolate, &argv[i], count)) return 1;
+			i += count - 1;
 		}
 	}
 	return 0;
 }
 
 
+// Starts reading and parsing every file in the background, then runs them
+// in order here as each one finishes compiling.
+bool RunFiles(v8::Isolate* isolate, char* files[], int count) {
+	std::vector<std::unique_ptr<StreamingCompile> > compiles;
+	for (int i = 0; i < count; i++) {
+		compiles.emplace_back(new StreamingCompile(isolate, files[i]));
+	}
+	for (int i = 0; i < count; i++) {
+		HandleScope handle_scope(isolate);
+		v8::TryCatch try_catch;
+		Handle<v8::Script> script;
+		{
+			// Only the wait for the background parse and the final compile step.
+			V8T_TRACE_SCOPE(Trace::Compile, "Compile");
+			script = compiles[i]->Finish(isolate);
+		}
+		if (compiles[i]->ReadFailed()) {
+			fprintf(stderr, "Error reading '%s'\n", files[i]);
+			continue;
+		}
+		if (script.IsEmpty()) {
+			// Print errors that happened during compilation.
+			ReportException(isolate, &try_catch);
+			return false;
+		}
+		bool terminated = false;
+		Handle<Value> result;
+		{
+			V8T_TRACE_SCOPE(Trace::Execute, "Run");
+			result = RunWithDeadline(isolate, script, &terminated);
+		}
+		if (result.IsEmpty()) {
+			// Print errors that happened during execution.
+			if (terminated && shed_last_run)
+				fprintf(stderr, "%s: stopped near the heap limit\n", files[i]);
+			else if (terminated)
+				fprintf(stderr, "%s: terminated after %d ms\n", files[i], timeout_ms);
+			else
+				ReportException(isolate, &try_catch);
+			return false;
+		}
+		HostIdle(isolate);
+	}
+	return true;
+}
+
+
+// Runs a top level script under the --timeout-ms/--soft-timeout-ms limits,
+// the isolate is usable again afterwards even if it had to be terminated,
+// by its deadline or by the heap policy.
+Handle<Value> RunWithDeadline(v8::Isolate* isolate, Handle<v8::Script> script, bool* terminated) {
+	Handle<Value> result;
+	if (timeout_ms <= 0 && soft_timeout_ms <= 0) {
+		result = script->Run();
+	}
+	else {
+		ExecutionDeadline deadline(isolate,
+			std::chrono::milliseconds(timeout_ms),
+			std::chrono::milliseconds(soft_timeout_ms));
+		result = script->Run();
+		*terminated = deadline.Terminated();
+	}
+	shed_last_run = TakeLoadShed();
+	if (shed_last_run) {
+		isolate->CancelTerminateExecution();
+		*terminated = true;
+	}
+	return result;
+}
+
+
 // The read-eval-execute loop of the shell.
 void RunShell(Handle<v8::Context> context) {
 	fprintf(stderr, "V8 version %s [sample shell]\n", v8::V8::GetVersion());
@@ -335,6 +789,8 @@ void RunShell(Handle<v8::Context> context) {
 		String::NewFromUtf8(context->GetIsolate(), "(shell)"));
 	while (true) {
 		char buffer[kBufferSize];
+		// Waiting on the next line is the longest idle gap there is.
+		HostIdle(context->GetIsolate());
 		fprintf(stderr, "> ");
 		char* str = fgets(buffer, kBufferSize, stdin);
 		if (str == NULL) break;
@@ -344,6 +800,7 @@ void RunShell(Handle<v8::Context> context) {
 			name,
 			true,
 			true);
+		PumpCompletions(context->GetIsolate());
 	}
 	fprintf(stderr, "\n");
 }
@@ -357,7 +814,11 @@ bool ExecuteString(v8::Isolate* isolate,
 	bool report_exceptions) {
 	HandleScope handle_scope(isolate);
 	v8::TryCatch try_catch;
-	Handle<v8::Script> script = v8::Script::Compile(source, name);
+	Handle<v8::Script> script;
+	{
+		V8T_TRACE_SCOPE(Trace::Compile, "Compile");
+		script = v8::Script::Compile(source, name);
+	}
 	if (script.IsEmpty()) {
 		// Print errors that happened during compilation.
 		if (report_exceptions)
@@ -365,11 +826,20 @@ bool ExecuteString(v8::Isolate* isolate,
 		return false;
 	}
 	else {
-		Handle<Value> result = script->Run();
+		bool terminated = false;
+		Handle<Value> result;
+		{
+			V8T_TRACE_SCOPE(Trace::Execute, "Run");
+			result = RunWithDeadline(isolate, script, &terminated);
+		}
 		if (result.IsEmpty()) {
 			assert(try_catch.HasCaught());
 			// Print errors that happened during execution.
-			if (report_exceptions)
+			if (terminated && shed_last_run)
+				fprintf(stderr, "Script stopped near the heap limit\n");
+			else if (terminated)
+				fprintf(stderr, "Script terminated after %d ms\n", timeout_ms);
+			else if (report_exceptions)
 				ReportException(isolate, &try_catch);
 			return false;
 		}
@@ -388,6 +858,16 @@ bool ExecuteString(v8::Isolate* isolate,
 }
 
 
+// Runs the completions of async gear calls back on this thread until nothing
+// is left in flight, this is what settles the promises they handed out.
+void PumpCompletions(v8::Isolate* isolate) {
+	CompletionQueue& queue = CompletionQueue::ForIsolate(isolate);
+	while (queue.HasPending()) {
+		queue.Drain(isolate, true);
+	}
+}
+
+
 void ReportException(v8::Isolate* isolate, v8::TryCatch* try_catch) {
 	HandleScope handle_scope(isolate);
 	String::Utf8Value exception(try_catch->Exception());
@@ -0,0 +1,148 @@
+// ScriptCache.cpp : Compiled scripts for load(), see ScriptCache.h.
+//
+
+#include "stdafx.h"
+
+#include <v8.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "V8Transmission.h"
+#include "ScriptCache.h"
+
+using namespace v8;
+
+using namespace V8Transmission;
+
+
+Handle<String> ReadFile(v8::Isolate* isolate, const char* name);
+
+
+// Resolves the file to the path the cache keys it by, and reads its stamp.
+// False if it doesn't exist.
+static bool StatFile(const char* file, std::string& path, FileStamp& stamp) {
+#if defined(_WIN32)
+	char full[_MAX_PATH];
+	if (_fullpath(full, file, _MAX_PATH) == NULL) return false;
+
+	struct _stat64 info;
+	if (_stat64(full, &info) != 0) return false;
+#else
+	char full[PATH_MAX];
+	if (realpath(file, full) == NULL) return false;
+
+	struct stat info;
+	if (stat(full, &info) != 0) return false;
+#endif
+	path = full;
+#if defined(_WIN32)
+	// Whole seconds only, ctime is the creation time here, which a replace
+	// through a new file still changes.
+	stamp.mtime = static_cast<int64_t>(info.st_mtime) * 1000000000;
+	stamp.ctime = static_cast<int64_t>(info.st_ctime) * 1000000000;
+#elif defined(__APPLE__)
+	stamp.mtime = static_cast<int64_t>(info.st_mtimespec.tv_sec) * 1000000000 + info.st_mtimespec.tv_nsec;
+	stamp.ctime = static_cast<int64_t>(info.st_ctimespec.tv_sec) * 1000000000 + info.st_ctimespec.tv_nsec;
+#else
+	stamp.mtime = static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+	stamp.ctime = static_cast<int64_t>(info.st_ctim.tv_sec) * 1000000000 + info.st_ctim.tv_nsec;
+#endif
+	stamp.inode = static_cast<uint64_t>(info.st_ino);
+	stamp.size = static_cast<int64_t>(info.st_size);
+	return true;
+}
+
+
+ScriptCache::ScriptCache()
+	: hits(0), misses(0), evictions(0), bytes(0), limit(kDefaultLimit) {
+}
+
+
+ScriptCache::~ScriptCache() {
+	Clear();
+}
+
+
+ScriptCache& ScriptCache::ForIsolate(v8::Isolate* isolate) {
+	return IsolateData::Get(isolate).Slot<ScriptCache>();
+}
+
+
+Local<v8::Script> ScriptCache::Get(v8::Isolate* isolate, const char* file) {
+	EscapableHandleScope handle_scope(isolate);
+
+	std::string path;
+	FileStamp stamp;
+	if (!StatFile(file, path, stamp)) return Local<v8::Script>();
+	size_t size = static_cast<size_t>(stamp.size);
+
+	std::unordered_map<std::string, EntryList::iterator>::iterator found = index.find(path);
+	if (found != index.end()) {
+		EntryList::iterator entry = found->second;
+		if (entry->stamp == stamp) {
+			hits++;
+			entries.splice(entries.begin(), entries, entry);
+			Local<v8::UnboundScript> unbound = Local<v8::UnboundScript>::New(isolate, entry->script);
+			return handle_scope.Escape(unbound->BindToCurrentContext());
+		}
+
+		// Changed on disk since it was compiled.
+		bytes -= static_cast<size_t>(entry->stamp.size);
+		entry->script.Reset();
+		entries.erase(entry);
+		index.erase(found);
+	}
+
+	misses++;
+
+	Handle<String> source_text = ReadFile(isolate, path.c_str());
+	if (source_text.IsEmpty()) return Local<v8::Script>();
+
+	v8::ScriptCompiler::Source source(source_text, v8::ScriptOrigin(String::NewFromUtf8(isolate, file)));
+	Local<v8::UnboundScript> unbound = v8::ScriptCompiler::CompileUnbound(isolate, &source);
+	if (unbound.IsEmpty()) return Local<v8::Script>();
+
+	// A file bigger than the whole budget is still used this once, it just
+	// isn't kept.
+	if (size > limit)
+		return handle_scope.Escape(unbound->BindToCurrentContext());
+
+	Evict(limit - size);
+
+	// Entry holds a non-copyable Persistent, it is built in place.
+	entries.emplace_front();
+	Entry& entry = entries.front();
+	entry.path = path;
+	entry.stamp = stamp;
+	entry.script.Reset(isolate, unbound);
+	index[path] = entries.begin();
+	bytes += size;
+
+	return handle_scope.Escape(unbound->BindToCurrentContext());
+}
+
+
+void ScriptCache::SetLimit(size_t new_limit) {
+	limit = new_limit;
+	Evict(limit);
+}
+
+
+void ScriptCache::Clear() {
+	Evict(0);
+}
+
+
+// Drops least recently used scripts until the cached sources fit in the budget.
+void ScriptCache::Evict(size_t budget) {
+	while (bytes > budget && !entries.empty()) {
+		Entry& last = entries.back();
+		bytes -= static_cast<size_t>(last.stamp.size);
+		last.script.Reset();
+		index.erase(last.path);
+		entries.pop_back();
+		evictions++;
+	}
+}
@@ -0,0 +1,72 @@
+// ScriptCache.h : Compiled scripts for load(), see ScriptCache.
+//
+
+#pragma once
+
+#include <v8.h>
+#include <list>
+#include <string>
+#include <stdint.h>
+#include <unordered_map>
+
+
+// What a cached script is checked against. Times are in nanoseconds where the
+// file system has them, so an edit within the same second that keeps the size
+// still counts, and the inode catches a file replaced by a rename.
+struct FileStamp
+{
+	int64_t mtime;
+	int64_t ctime;
+	uint64_t inode;
+	int64_t size;
+
+	bool operator==(const FileStamp& other) const {
+		return mtime == other.mtime && ctime == other.ctime && inode == other.inode && size == other.size;
+	}
+};
+
+
+// Keeps the UnboundScripts load() compiles, keyed by canonical path and
+// checked against the file's FileStamp, so loading an unchanged file
+// again costs a stat and a bind. Least recently used scripts are dropped once
+// the sources held exceed the limit.
+class ScriptCache
+{
+public:
+	static const size_t kDefaultLimit = 64 * 1024 * 1024;
+
+	ScriptCache();
+	~ScriptCache();
+
+	// The cache for this isolate, UnboundScripts can't be shared between them.
+	static ScriptCache& ForIsolate(v8::Isolate* isolate);
+
+	// The script for a file bound to the current context. Returns an empty
+	// handle if the file can't be read, or if it fails to compile, in which
+	// case the exception is left pending for the caller's TryCatch.
+	v8::Local<v8::Script> Get(v8::Isolate* isolate, const char* file);
+
+	void SetLimit(size_t bytes);
+	void Clear();
+
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
+	size_t bytes;
+
+private:
+	struct Entry
+	{
+		std::string path;
+		FileStamp stamp;
+		v8::Persistent<v8::UnboundScript> script;
+	};
+
+	typedef std::list<Entry> EntryList;
+
+	void Evict(size_t limit);
+
+	EntryList entries;	// most recently used first
+	std::unordered_map<std::string, EntryList::iterator> index;
+	size_t limit;
+};
@@ -0,0 +1,144 @@
+// StreamingCompile.cpp : Reads and parses script files off the main thread,
+// see StreamingCompile.h.
+//
+
+#include "stdafx.h"
+
+#include <v8.h>
+#include <string.h>
+
+#include "StreamingCompile.h"
+
+using namespace v8;
+
+
+StreamingCompile::StreamingCompile(v8::Isolate* isolate, const char* file_name)
+	: file(file_name), read_failed(false), read_done(false) {
+#if V8T_V8_AT_LEAST(3, 30)
+	streamed = NULL;
+	task = NULL;
+#endif
+
+	FILE* handle = fopen(file_name, "rb");
+	if (handle == NULL) {
+		read_failed = true;
+		read_done = true;
+		return;
+	}
+
+	// Small files are just read here, Finish compiles them as usual.
+	long size = -1;
+	if (fseek(handle, 0, SEEK_END) == 0) size = ftell(handle);
+	rewind(handle);
+	if (size >= 0 && static_cast<size_t>(size) < kMinBackgroundSize) {
+		ReadChunks(handle);
+		return;
+	}
+
+#if V8T_V8_AT_LEAST(3, 30)
+	// The task has to be created on the isolate's thread, only Run moves off it.
+	streamed = new v8::ScriptCompiler::StreamedSource(new ChunkStream(this), v8::ScriptCompiler::StreamedSource::UTF8);
+	task = v8::ScriptCompiler::StartStreamingScript(isolate, streamed);
+	if (task != NULL) {
+		parser = std::thread([this]() { task->Run(); });
+	}
+#endif
+
+	reader = std::thread([this, handle]() { ReadChunks(handle); });
+}
+
+
+StreamingCompile::~StreamingCompile() {
+	if (reader.joinable()) reader.join();
+
+#if V8T_V8_AT_LEAST(3, 30)
+	if (parser.joinable()) parser.join();
+	delete task;
+	delete streamed;
+#endif
+
+	for (size_t i = 0; i < chunks.size(); i++) {
+		delete[] chunks[i].first;
+	}
+}
+
+
+// Reader thread, keeps the whole text and queues a copy of each chunk for the
+// parser, which takes ownership of what it is handed.
+void StreamingCompile::ReadChunks(FILE* handle) {
+	for (;;) {
+		uint8_t* chunk = new uint8_t[kChunkSize];
+		size_t read = fread(chunk, 1, kChunkSize, handle);
+		if (read == 0) {
+			delete[] chunk;
+			break;
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		source.append(reinterpret_cast<const char*>(chunk), read);
+#if V8T_V8_AT_LEAST(3, 30)
+		if (task != NULL) {
+			chunks.push_back(std::make_pair(chunk, read));
+			chunk_ready.notify_one();
+			continue;
+		}
+#endif
+		delete[] chunk;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	read_failed = ferror(handle) != 0;
+	read_done = true;
+	chunk_ready.notify_all();
+
+	fclose(handle);
+}
+
+
+#if V8T_V8_AT_LEAST(3, 30)
+// Parser thread, blocks until the reader has something, 0 ends the script.
+size_t StreamingCompile::ChunkStream::GetMoreData(const uint8_t** src) {
+	std::unique_lock<std::mutex> lock(owner->mutex);
+	owner->chunk_ready.wait(lock, [this]() { return !owner->chunks.empty() || owner->read_done; });
+
+	if (owner->chunks.empty()) {
+		*src = NULL;
+		return 0;
+	}
+
+	std::pair<uint8_t*, size_t> chunk = owner->chunks.front();
+	owner->chunks.pop_front();
+
+	*src = chunk.first;
+	return chunk.second;
+}
+#endif
+
+
+Local<v8::Script> StreamingCompile::Finish(v8::Isolate* isolate) {
+	EscapableHandleScope handle_scope(isolate);
+
+	if (reader.joinable()) reader.join();
+	if (read_failed) {
+#if V8T_V8_AT_LEAST(3, 30)
+		if (parser.joinable()) parser.join();
+#endif
+		return Local<v8::Script>();
+	}
+
+	Handle<String> name = String::NewFromUtf8(isolate, file.c_str());
+	Handle<String> text = String::NewFromUtf8(isolate, source.data(), String::kNormalString, static_cast<int>(source.size()));
+
+#if V8T_V8_AT_LEAST(3, 30)
+	if (task != NULL) {
+		parser.join();
+#if V8T_V8_AT_LEAST(4, 3)
+		return handle_scope.Escape(v8::ScriptCompiler::Compile(isolate->GetCurrentContext(), streamed, text, v8::ScriptOrigin(name)).FromMaybe(Local<v8::Script>()));
+#else
+		return handle_scope.Escape(v8::ScriptCompiler::Compile(isolate, streamed, text, v8::ScriptOrigin(name)));
+#endif
+	}
+#endif
+
+	return handle_scope.Escape(v8::Script::Compile(text, name));
+}
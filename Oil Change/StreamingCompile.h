@@ -0,0 +1,84 @@
+// StreamingCompile.h : Reads and parses script files off the main thread,
+// see StreamingCompile.
+//
+
+#pragma once
+
+#include <v8.h>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <stdint.h>
+#include <condition_variable>
+
+#include "V8Transmission.h"
+
+
+// Compiles one script file in the background. A reader thread pulls the file
+// in chunks and, where V8 supports script streaming, hands each chunk to the
+// parser running on a second thread while the rest is still being read, so
+// the main thread only finalizes the compile. Older V8 gets the file read in
+// the background and compiled on the main thread.
+//
+// The V8 this tree builds against is older than 3.30 (Isolate::GetCurrent,
+// kNormalString and ExternalAsciiStringResource are all used elsewhere), so
+// here only the read is moved off the main thread, and the whole parse still
+// happens in Finish. Don't expect a parse speedup from it until the tree moves
+// to a V8 with script streaming.
+//
+// Files smaller than kMinBackgroundSize are read and compiled right away on
+// the calling thread, starting threads for them costs more than it saves.
+//
+// Start several at once to have their files read and parsed concurrently.
+class StreamingCompile
+{
+public:
+	static const size_t kChunkSize = 256 * 1024;
+	static const size_t kMinBackgroundSize = 64 * 1024;
+
+	StreamingCompile(v8::Isolate* isolate, const char* file);
+	~StreamingCompile();
+
+	// Waits for the background work and compiles in the current context.
+	// Returns an empty handle if the file couldn't be read (ReadFailed) or
+	// didn't compile, in which case the exception is left for the caller's
+	// TryCatch.
+	v8::Local<v8::Script> Finish(v8::Isolate* isolate);
+
+	bool ReadFailed() const { return read_failed; }
+	const std::string& File() const { return file; }
+
+private:
+	StreamingCompile(const StreamingCompile&);
+	StreamingCompile& operator=(const StreamingCompile&);
+
+	void ReadChunks(FILE* handle);
+
+#if V8T_V8_AT_LEAST(3, 30)
+	// Feeds the parser the chunks as ReadChunks queues them.
+	class ChunkStream : public v8::ScriptCompiler::ExternalSourceStream
+	{
+	public:
+		explicit ChunkStream(StreamingCompile* owner) : owner(owner) {}
+		virtual size_t GetMoreData(const uint8_t** src);
+
+	private:
+		StreamingCompile* owner;
+	};
+
+	v8::ScriptCompiler::StreamedSource* streamed;
+	v8::ScriptCompiler::ScriptStreamingTask* task;
+	std::thread parser;
+#endif
+
+	std::string file;
+	std::string source;		// everything read so far, V8 wants the whole text to finish
+	bool read_failed;
+
+	std::mutex mutex;
+	std::condition_variable chunk_ready;
+	std::deque<std::pair<uint8_t*, size_t> > chunks;
+	bool read_done;
+	std::thread reader;
+};
@@ -0,0 +1,329 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+///	The MIT License (MIT)
+///
+///	Copyright (c) 2014 Gregory Hlavac
+///
+///	Permission is hereby granted, free of charge, to any person obtaining a copy
+///	of this software and associated documentation files (the "Software"), to deal
+///	in the Software without restriction, including without limitation the rights
+///	to use, copy, modify, merge, publish, distribute, sub-license, and/or sell
+///	copies of the Software, and to permit persons to whom the Software is
+///	furnished to do so, subject to the following conditions:
+///
+///	The above copyright notice and this permission notice shall be included in
+///	all copies or substantial portions of the Software.
+///
+///	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+///	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+///	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+///	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+///	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+///	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+///	THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <v8.h>
+
+#include <array>
+#include <string>
+#include <type_traits>
+
+#include "Common.h"
+#include "ClassGears.h"
+
+namespace V8Transmission
+{
+	namespace Internal
+	{
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		/// <summary>
+		/// 	The array views made for one wrapper, kept by member name in a null prototype object under a
+		/// 	hidden value. Detach neuters the TypedArrays among them, so a view the script held on to
+		/// 	reads as empty instead of freed memory. Only what calls Detach gets that, nothing notices
+		/// 	a container reallocating by itself.
+		/// </summary>
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		struct NativeViews
+		{
+			v8::Persistent<v8::String>	viewsKey;
+			v8::Persistent<v8::String>	ownerKey;
+
+			~NativeViews()
+			{
+				viewsKey.Reset();
+				ownerKey.Reset();
+			}
+
+			/** The isolate's keys, made once instead of on every access. */
+			static NativeViews& Get(v8::Isolate* iso)
+			{
+				NativeViews& views = IsolateData::Get(iso).Slot<NativeViews>();
+
+				if (views.viewsKey.IsEmpty())
+				{
+					views.viewsKey.Reset(iso, v8::String::NewFromUtf8(iso, "V8Transmission::Views", v8::String::kInternalizedString));
+					views.ownerKey.Reset(iso, v8::String::NewFromUtf8(iso, "V8Transmission::ViewOwner", v8::String::kInternalizedString));
+				}
+
+				return views;
+			}
+
+			/** The wrapper's views by member name, an empty handle if it has none and create is false. */
+			static v8::Local<v8::Object> Of(v8::Isolate* iso, v8::Local<v8::Object> wrapper, bool create)
+			{
+				v8::Local<v8::String> key = v8::Local<v8::String>::New(iso, Get(iso).viewsKey);
+				v8::Local<v8::Value> views = wrapper->GetHiddenValue(key);
+
+				if (!views.IsEmpty() && views->IsObject())
+					return views.As<v8::Object>();
+
+				if (!create)
+					return v8::Local<v8::Object>();
+
+				v8::Local<v8::Object> created = v8::Object::New(iso);
+				created->SetPrototype(v8::Null(iso));
+				wrapper->SetHiddenValue(key, created);
+
+				return created;
+			}
+
+			/** Neuters a TypedArray view, indexed views look their object up on every access and need nothing. */
+			static void Neuter(v8::Local<v8::Value> view)
+			{
+				if (view->IsTypedArray())
+					view.As<v8::TypedArray>()->Buffer()->Neuter();
+			}
+
+			/** Neuters every view of the wrapper, for when its object is moved out or released under it. */
+			static void Detach(v8::Isolate* iso, v8::Local<v8::Object> wrapper)
+			{
+				v8::Local<v8::Object> views = Of(iso, wrapper, false);
+
+				if (views.IsEmpty())
+					return;
+
+				v8::Local<v8::Array> names = views->GetOwnPropertyNames();
+
+				for (uint32_t i = 0; i < names->Length(); i++)
+					Neuter(views->Get(names->Get(i)));
+
+				wrapper->DeleteHiddenValue(v8::Local<v8::String>::New(iso, Get(iso).viewsKey));
+			}
+		};
+
+		/** Containers whose storage stays put for the life of the object, a TypedArray over them can't dangle. */
+		template <typename Container>
+		struct FixedStorage : std::false_type {};
+
+		template <typename T, size_t N>
+		struct FixedStorage<std::array<T, N> > : std::true_type {};
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	/// <summary>
+	/// 	Binds a contiguous container member (std::vector, std::array) of a ClassGear type as an
+	/// 	array-like view that reads and writes the elements in place, where MemberVariableGear
+	/// 	converts and copies the whole container on every access. obj.items[i] in a loop is then
+	/// 	O(1) per step instead of O(n).
+	/// 	
+	/// 	With Typed, numeric elements with a matching typed array get a real TypedArray over the
+	/// 	container's storage, so element access never leaves generated code. Everything else gets an
+	/// 	object with indexed property handlers converting single elements through
+	/// 	ShiftJS/ShiftNative and a read only length. Writes past the end throw a RangeError, the view
+	/// 	never resizes.
+	/// 	
+	/// 	Either way the view is cached on the wrapper and keeps it alive. An indexed view finds the
+	/// 	object through the wrapper on each access and throws once it is gone, so it is always safe.
+	/// 	A TypedArray points straight at the storage as it was when the view was made, and a script
+	/// 	can keep it (var s = obj.samples;). Its views are neutered when the object is moved out of
+	/// 	the wrapper, but nothing notices native code resizing or reallocating the container. That
+	/// 	is why Typed is only on by default for std::array. Binding a std::vector with Typed true is
+	/// 	a promise that native code calls Detach with the wrapper after every change that can move
+	/// 	its storage, and before the script runs again. Otherwise a kept view reads freed memory.
+	/// </summary>
+	///
+	/// <typeparam name="ThisClass">	The class the member belongs to. </typeparam>
+	/// <typeparam name="Container">	Type of the container. </typeparam>
+	/// <typeparam name="Member">   	The member. </typeparam>
+	/// <typeparam name="Typed">		true for a TypedArray over numeric elements, see above. </typeparam>
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	template <typename ThisClass, typename Container, Container ThisClass::*Member, bool Typed = Internal::FixedStorage<Container>::value>
+	struct MemberArrayViewGear
+	{
+		typedef ClassGear<ThisClass>					CG;
+		typedef typename Container::value_type			ElementType;
+		typedef std::integral_constant<bool, Typed && Internal::HasTypedArray<ElementType>::value>	UsesTypedArray;
+
+		static void Getter(v8::Local<v8::String> property, const v8::PropertyCallbackInfo<v8::Value>& info)
+		{
+			v8::Isolate* iso = info.GetIsolate();
+			ThisClass* var = CG::UnwrapUnchecked(iso, info.This());
+
+			if (var == nullptr)
+			{
+				CG::ThrowReleased(iso);
+				return;
+			}
+
+			v8::Local<v8::Object> views = Internal::NativeViews::Of(iso, info.This(), true);
+			v8::Local<v8::Value> cached = views->Get(property);
+
+			if (!cached->IsUndefined())
+			{
+				if (Current(var, cached, UsesTypedArray()))
+				{
+					info.GetReturnValue().Set(cached);
+					return;
+				}
+
+				// The container moved its storage, the old view must not reach it any more.
+				Internal::NativeViews::Neuter(cached);
+			}
+
+			v8::Local<v8::Object> view = MakeView(iso, var, info.This(), UsesTypedArray());
+
+			views->Set(property, view);
+			info.GetReturnValue().Set(view);
+		}
+
+		static void Bind(v8::Isolate* iso, const char* name)
+		{
+			v8::Local<v8::ObjectTemplate> protoTmpl = CG::PrototypeTemplate(iso);
+			protoTmpl->SetAccessor(v8::String::NewFromUtf8(iso, name), Getter, nullptr, v8::Handle<v8::Value>(), v8::DEFAULT, v8::None, CG::ReceiverAccessorSignature(iso));
+		}
+
+		/** Neuters every view handed out for the wrapper, the next read makes new ones. Call it after moving the storage. */
+		static void Detach(v8::Isolate* iso, v8::Local<v8::Object> wrapper)
+		{
+			Internal::NativeViews::Detach(iso, wrapper);
+		}
+
+	private:
+		struct ViewTemplate
+		{
+			v8::Persistent<v8::ObjectTemplate>	handle;
+
+			~ViewTemplate() { handle.Reset(); }
+		};
+
+		/** The container behind an indexed view, nullptr once its object was moved out of the wrapper. */
+		template <typename T>
+		static Container* Of(const v8::PropertyCallbackInfo<T>& info)
+		{
+			ThisClass* var = CG::UnwrapUnchecked(info.GetIsolate(), info.Holder()->GetInternalField(0).template As<v8::Object>());
+
+			return var != nullptr ? &(var->*Member) : nullptr;
+		}
+
+		/** An indexed view reads through to the container, a TypedArray made before a resize is replaced on the next read. */
+		static bool Current(ThisClass* var, v8::Local<v8::Value> cached, std::false_type)
+		{
+			return true;
+		}
+
+		static bool Current(ThisClass* var, v8::Local<v8::Value> cached, std::true_type)
+		{
+			Container& container = var->*Member;
+			v8::Local<v8::TypedArray> array = cached.As<v8::TypedArray>();
+
+			return array->Length() == container.size() && array->Buffer()->GetContents().Data() == static_cast<void*>(container.data());
+		}
+
+		static v8::Local<v8::Object> MakeView(v8::Isolate* iso, ThisClass* var, v8::Local<v8::Object> owner, std::true_type)
+		{
+			Container& container = var->*Member;
+
+			v8::Local<v8::ArrayBuffer> buffer = v8::ArrayBuffer::New(iso, container.data(), container.size() * sizeof(ElementType));
+			v8::Local<v8::Object> view = Internal::TypedArrayFor<ElementType>::Type::New(buffer, 0, container.size());
+
+			view->SetHiddenValue(v8::Local<v8::String>::New(iso, Internal::NativeViews::Get(iso).ownerKey), owner);
+
+			return view;
+		}
+
+		static v8::Local<v8::Object> MakeView(v8::Isolate* iso, ThisClass* var, v8::Local<v8::Object> owner, std::false_type)
+		{
+			ViewTemplate& tmpl = IsolateData::Get(iso).Slot<ViewTemplate>();
+
+			if (tmpl.handle.IsEmpty())
+			{
+				v8::Local<v8::ObjectTemplate> created = v8::ObjectTemplate::New(iso);
+				created->SetInternalFieldCount(1);
+				created->SetIndexedPropertyHandler(IndexGetter, IndexSetter, IndexQuery, nullptr, IndexEnumerator);
+				created->SetAccessor(v8::String::NewFromUtf8(iso, "length"), LengthGetter, nullptr, v8::Handle<v8::Value>(), v8::DEFAULT, static_cast<v8::PropertyAttribute>(v8::ReadOnly | v8::DontEnum));
+
+				tmpl.handle.Reset(iso, created);
+			}
+
+			v8::Local<v8::Object> view = v8::Local<v8::ObjectTemplate>::New(iso, tmpl.handle)->NewInstance();
+
+			// The wrapper rather than the object, it keeps the wrapper alive and sees the object go.
+			view->SetInternalField(0, owner);
+
+			return view;
+		}
+
+		static void IndexGetter(uint32_t index, const v8::PropertyCallbackInfo<v8::Value>& info)
+		{
+			Container* container = Of(info);
+
+			if (container == nullptr)
+				CG::ThrowReleased(info.GetIsolate());
+			else if (index < container->size())
+				info.GetReturnValue().Set(ConvertToJS(info.GetIsolate(), static_cast<const ElementType&>((*container)[index])));
+		}
+
+		static void IndexSetter(uint32_t index, v8::Local<v8::Value> value, const v8::PropertyCallbackInfo<v8::Value>& info)
+		{
+			Container* container = Of(info);
+
+			if (container == nullptr)
+			{
+				CG::ThrowReleased(info.GetIsolate());
+				return;
+			}
+
+			if (index >= container->size())
+			{
+				info.GetIsolate()->ThrowException(v8::Exception::RangeError(v8::String::NewFromUtf8(info.GetIsolate(), "Index past the end of a native array view")));
+				return;
+			}
+
+			(*container)[index] = ConvertFromJS<ElementType>(info.GetIsolate(), value);
+			info.GetReturnValue().Set(value);
+		}
+
+		static void IndexQuery(uint32_t index, const v8::PropertyCallbackInfo<v8::Integer>& info)
+		{
+			Container* container = Of(info);
+
+			if (container != nullptr && index < container->size())
+				info.GetReturnValue().Set(v8::Integer::New(info.GetIsolate(), v8::DontDelete));
+		}
+
+		static void IndexEnumerator(const v8::PropertyCallbackInfo<v8::Array>& info)
+		{
+			v8::Isolate* iso = info.GetIsolate();
+			Container* container = Of(info);
+			size_t size = container != nullptr ? container->size() : 0;
+
+			v8::Local<v8::Array> indices = v8::Array::New(iso, static_cast<int>(size));
+
+			for (size_t i = 0; i < size; i++)
+				indices->Set(static_cast<uint32_t>(i), v8::Integer::NewFromUnsigned(iso, static_cast<uint32_t>(i)));
+
+			info.GetReturnValue().Set(indices);
+		}
+
+		static void LengthGetter(v8::Local<v8::String> property, const v8::PropertyCallbackInfo<v8::Value>& info)
+		{
+			Container* container = Of(info);
+
+			if (container == nullptr)
+				CG::ThrowReleased(info.GetIsolate());
+			else
+				info.GetReturnValue().Set(v8::Number::New(info.GetIsolate(), static_cast<double>(container->size())));
+		}
+	};
+}
@@ -0,0 +1,550 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+///	The MIT License (MIT)
+///
+///	Copyright (c) 2014 Gregory Hlavac
+///
+///	Permission is hereby granted, free of charge, to any person obtaining a copy
+///	of this software and associated documentation files (the "Software"), to deal
+///	in the Software without restriction, including without limitation the rights
+///	to use, copy, modify, merge, publish, distribute, sub-license, and/or sell
+///	copies of the Software, and to permit persons to whom the Software is
+///	furnished to do so, subject to the following conditions:
+///
+///	The above copyright notice and this permission notice shall be included in
+///	all copies or substantial portions of the Software.
+///
+///	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+///	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+///	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+///	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+///	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+///	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+///	THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <v8.h>
+
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <tuple>
+#include <thread>
+#include <vector>
+#include <string>
+#include <exception>
+#include <functional>
+#include <type_traits>
+#include <condition_variable>
+
+#include "Common.h"
+#include "ClassGears.h"
+
+using v8::Value;
+using v8::Local;
+using v8::Handle;
+using v8::Object;
+using v8::Isolate;
+using v8::Persistent;
+using v8::ObjectTemplate;
+using v8::FunctionTemplate;
+using v8::FunctionCallbackInfo;
+
+namespace V8Transmission
+{
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	/// <summary>
+	/// 	A shared pool of native worker threads that async gears push their native calls onto.
+	///
+	/// 	Jobs handed to the pool must never touch V8, anything that needs the isolate has to be
+	/// 	posted back through that isolate's CompletionQueue.
+	/// </summary>
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	class WorkerPool
+	{
+	public:
+		typedef std::function<void()> Job;
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		/// <summary>
+		/// 	Returns the process wide pool, created on first use with one thread per hardware thread.
+		/// </summary>
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		static WorkerPool& Shared()
+		{
+			static WorkerPool pool(std::thread::hardware_concurrency());
+
+			return pool;
+		}
+
+		void Post(Job job)
+		{
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				jobs.push_back(std::move(job));
+			}
+
+			wake.notify_one();
+		}
+
+		~WorkerPool()
+		{
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				stopping = true;
+			}
+
+			wake.notify_all();
+
+			for (size_t i = 0; i < threads.size(); i++)
+				threads[i].join();
+		}
+
+	private:
+		explicit WorkerPool(unsigned thread_count) : stopping(false)
+		{
+			if (thread_count < 2)
+				thread_count = 2;
+
+			for (unsigned i = 0; i < thread_count; i++)
+				threads.push_back(std::thread(&WorkerPool::Run, this));
+		}
+
+		WorkerPool(const WorkerPool&);
+		WorkerPool& operator=(const WorkerPool&);
+
+		void Run()
+		{
+			for (;;)
+			{
+				Job job;
+
+				{
+					std::unique_lock<std::mutex> guard(lock);
+
+					while (!stopping && jobs.empty())
+						wake.wait(guard);
+
+					if (jobs.empty())
+						return;
+
+					job = std::move(jobs.front());
+					jobs.pop_front();
+				}
+
+				job();
+			}
+		}
+
+		std::mutex					lock;
+		std::condition_variable		wake;
+		std::deque<Job>				jobs;
+		std::vector<std::thread>	threads;
+		bool						stopping;
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	/// <summary>
+	/// 	A per-isolate queue of completions that have to run back on the isolate's own thread.
+	///
+	/// 	Worker threads Post into it, the host loop (Oil Change in the sample) calls Drain to run
+	/// 	them, which resolves the promises handed out by the async gears. HasPending tells the host
+	/// 	whether there is still work in flight it should keep waiting on.
+	///
+	/// 	Anything that posts from another thread holds the queue through Share, so a completion that
+	/// 	arrives after IsolateData::Dispose lands in a queue nobody drains any more instead of freed
+	/// 	memory.
+	/// </summary>
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	class CompletionQueue
+	{
+	public:
+		typedef std::function<void(v8::Isolate*)> Completion;
+
+		/** The isolate's queue, for use on the isolate's thread only. */
+		static CompletionQueue& ForIsolate(v8::Isolate* iso)
+		{
+			return *Share(iso);
+		}
+
+		/** The isolate's queue for whatever posts to it from other threads. Call it on the isolate's thread. */
+		static std::shared_ptr<CompletionQueue> Share(v8::Isolate* iso)
+		{
+			std::shared_ptr<CompletionQueue>& queue = IsolateData::Get(iso).Slot<Owner>().queue;
+
+			if (!queue)
+				queue.reset(new CompletionQueue);
+
+			return queue;
+		}
+
+		/** Marks an operation as in flight, must be called on the isolate thread before it is dispatched. */
+		void BeginOperation()
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			pending++;
+		}
+
+		/** Queues the completion of an operation started with BeginOperation, callable from any thread. */
+		void Post(Completion completion)
+		{
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				completions.push_back(std::move(completion));
+			}
+
+			wake.notify_one();
+		}
+
+		/** Queues work that wasn't started with BeginOperation, callable from any thread. */
+		void PostDetached(Completion completion)
+		{
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				pending++;
+				completions.push_back(std::move(completion));
+			}
+
+			wake.notify_one();
+		}
+
+		bool HasPending()
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			return pending != 0;
+		}
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		/// <summary>
+		/// 	Runs every completion that has arrived so far on the calling (isolate) thread, then runs the
+		/// 	microtask queue so promise reactions fire before control goes back to the host.
+		/// </summary>
+		///
+		/// <param name="iso"> 	The isolate that owns this queue. </param>
+		/// <param name="wait">	If true and operations are in flight, blocks until at least one arrives. </param>
+		///
+		/// <returns>
+		/// 	The number of completions that were run.
+		/// </returns>
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		size_t Drain(v8::Isolate* iso, bool wait)
+		{
+			std::deque<Completion> ready;
+
+			{
+				std::unique_lock<std::mutex> guard(lock);
+
+				if (wait)
+				{
+					while (completions.empty() && pending != 0)
+						wake.wait(guard);
+				}
+
+				ready.swap(completions);
+			}
+
+			for (size_t i = 0; i < ready.size(); i++)
+			{
+				v8::HandleScope scope(iso);
+				ready[i](iso);
+			}
+
+			if (!ready.empty())
+			{
+				{
+					std::lock_guard<std::mutex> guard(lock);
+					pending -= ready.size();
+				}
+
+				iso->RunMicrotasks();
+			}
+
+			return ready.size();
+		}
+
+	private:
+		/** The IsolateData slot, lets go of the isolate's reference on Dispose. */
+		struct Owner
+		{
+			std::shared_ptr<CompletionQueue> queue;
+		};
+
+		CompletionQueue() : pending(0) {}
+
+		CompletionQueue(const CompletionQueue&);
+		CompletionQueue& operator=(const CompletionQueue&);
+
+		std::mutex					lock;
+		std::condition_variable		wake;
+		std::deque<Completion>		completions;
+		size_t						pending;
+	};
+
+	namespace Internal
+	{
+		namespace Async_Convert_Dispatch_Resolve
+		{
+			/** Holds the outcome of the native call until it is handed back to the isolate thread. */
+			template <typename ReturnType>
+			struct Result
+			{
+				// Only built once the call returns, so ReturnType needn't be default constructible.
+				std::unique_ptr<ReturnType> value;
+
+				template <typename Call>
+				void Produce(Call call) { value.reset(new ReturnType(call())); }
+
+				ValueHandle ToJS(Isolate* iso) { return ConvertToJS(iso, std::move(*value)); }
+			};
+
+			template <>
+			struct Result<void>
+			{
+				template <typename Call>
+				void Produce(Call call) { call(); }
+
+				ValueHandle ToJS(Isolate* iso) { return v8::Undefined(iso); }
+			};
+
+			////////////////////////////////////////////////////////////////////////////////////////////////////
+			/// <summary>
+			/// 	A single in flight native call, owns the converted arguments, the promise resolver and the
+			/// 	context it has to be resolved in. Deletes itself once it has been settled.
+			/// </summary>
+			////////////////////////////////////////////////////////////////////////////////////////////////////
+			template <typename Callable, typename ReturnType, typename... Args>
+			struct Operation
+			{
+				typedef std::tuple<typename std::decay<Args>::type...> ArgumentTuple;
+				typedef typename BuildIndexList<sizeof...(Args)>::Type Indices;
+
+				Operation(const FunctionCallbackInfo<Value>& args, Callable callable)
+					: callable(callable), arguments(Convert(args, Indices())), failed(false)
+				{
+					Isolate* iso = args.GetIsolate();
+
+					resolver.Reset(iso, v8::Promise::Resolver::New(iso));
+					context.Reset(iso, iso->GetCurrentContext());
+				}
+
+				/** Keeps the JS object the call was made on alive until the operation settles. */
+				void Retain(Isolate* iso, Handle<Object> holder)
+				{
+					receiver.Reset(iso, holder);
+				}
+
+				Local<v8::Promise> Promise(Isolate* iso)
+				{
+					return Local<v8::Promise::Resolver>::New(iso, resolver)->GetPromise();
+				}
+
+				void Dispatch(Isolate* iso)
+				{
+					std::shared_ptr<CompletionQueue> queue = CompletionQueue::Share(iso);
+					queue->BeginOperation();
+
+					Operation* self = this;
+
+					WorkerPool::Shared().Post([self, queue]()
+					{
+						self->Execute();
+						queue->Post([self](Isolate* iso) { self->Settle(iso); });
+					});
+				}
+
+			private:
+				template <int... I>
+				static ArgumentTuple Convert(const FunctionCallbackInfo<Value>& args, IndexList<I...>)
+				{
+					return ArgumentTuple(ConvertFromJS<typename std::decay<Args>::type>(args.GetIsolate(), args[I])...);
+				}
+
+				template <int... I>
+				ReturnType Call(IndexList<I...>)
+				{
+					return callable(std::move(std::get<I>(arguments))...);
+				}
+
+				// Runs on a worker thread, so nothing in here may touch V8.
+				void Execute()
+				{
+					try
+					{
+						result.Produce([this]() { return Call(Indices()); });
+					}
+					catch (const std::exception& e)
+					{
+						failed = true;
+						error = e.what();
+					}
+					catch (...)
+					{
+						failed = true;
+						error = "Unknown native exception.";
+					}
+				}
+
+				// Runs on the isolate thread from CompletionQueue::Drain, inside a HandleScope.
+				void Settle(Isolate* iso)
+				{
+					Local<v8::Context> ctx = Local<v8::Context>::New(iso, context);
+					v8::Context::Scope context_scope(ctx);
+
+					Local<v8::Promise::Resolver> lresolver = Local<v8::Promise::Resolver>::New(iso, resolver);
+
+					if (failed)
+						lresolver->Reject(v8::Exception::Error(v8::String::NewFromUtf8(iso, error.c_str())));
+					else
+						lresolver->Resolve(result.ToJS(iso));
+
+					resolver.Reset();
+					context.Reset();
+					receiver.Reset();
+
+					delete this;
+				}
+
+				Callable								callable;
+				ArgumentTuple							arguments;
+				Result<ReturnType>						result;
+				bool									failed;
+				std::string								error;
+
+				Persistent<v8::Promise::Resolver>		resolver;
+				Persistent<v8::Context>					context;
+				Persistent<Object>						receiver;
+			};
+
+			template <class ThisClass, typename ReturnType, typename... Args>
+			struct BoundMember
+			{
+				typedef ReturnType(ThisClass::*MemberFunctionPtr)(Args...);
+
+				ThisClass*			ptr;
+				MemberFunctionPtr	mfptr;
+
+				template <typename... Forwarded>
+				ReturnType operator()(Forwarded&&... forwarded)
+				{
+					return (ptr->*mfptr)(std::forward<Forwarded>(forwarded)...);
+				}
+			};
+		}
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	/// <summary>
+	/// 	An async static function gear.
+	///
+	/// 	Same as StaticFunctionGear except the bound function returns a Promise to javascript, the
+	/// 	arguments are converted on the JS thread, the native function runs on the WorkerPool and the
+	/// 	promise is resolved (or rejected with the what() of a thrown std::exception) once the host
+	/// 	loop drains the isolate's CompletionQueue.
+	///
+	/// 	Example
+	///
+	/// 	uint32_t checksum(std::string data) { ... }
+	///
+	/// 	...
+	/// 	global->Set(String::NewFromUtf8(isolate, "checksum"), FunctionTemplate::New(isolate, AsyncFunctionGear<uint32_t, std::string>::Invoke<checksum>));
+	/// 	...
+	/// 	CompletionQueue::ForIsolate(isolate).Drain(isolate, true);
+	///
+	/// </summary>
+	///
+	/// <typeparam name="ReturnType">   	Type of the return type. </typeparam>
+	/// <typeparam name="ArgumentTypes">	Type of the argument types. </typeparam>
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	template <typename ReturnType, typename... ArgumentTypes>
+	struct AsyncFunctionGear
+	{
+		typedef ReturnType(*StaticFunctionPtr) (ArgumentTypes...);
+
+		typedef Internal::Async_Convert_Dispatch_Resolve::Operation<StaticFunctionPtr, ReturnType, ArgumentTypes...> Operation;
+
+		template <StaticFunctionPtr sfptr>
+		static void Invoke(const FunctionCallbackInfo<Value>& args)
+		{
+			V8T_TRACE_GEAR(args, "AsyncFunctionGear");
+
+			Isolate* iso = args.GetIsolate();
+
+			Operation* op = new Operation(args, sfptr);
+			args.GetReturnValue().Set(op->Promise(iso));
+			op->Dispatch(iso);
+		}
+
+		template <StaticFunctionPtr sfptr>
+		static void Bind(Isolate* iso, const Handle<ObjectTemplate>& tmpl, const char* name)
+		{
+			Local<FunctionTemplate> lft = FunctionTemplate::New(iso, Invoke<sfptr>);
+			lft->SetClassName(v8::String::NewFromUtf8(iso, name));
+
+			tmpl->Set(v8::String::NewFromUtf8(iso, name), lft);
+		}
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	/// <summary>
+	/// 	An async member function gear.
+	///
+	/// 	The async counterpart to MemberFunctionGear, the wrapper object the method was called on is
+	/// 	kept alive until the promise settles. The native object itself is still shared with the
+	/// 	isolate thread while the call runs, so it is up to the bound class to be safe for that.
+	/// </summary>
+	///
+	/// <typeparam name="ThisClass">		Type of this class. </typeparam>
+	/// <typeparam name="ReturnType">   	Type of the return type. </typeparam>
+	/// <typeparam name="ArgumentTypes">	Type of the argument types. </typeparam>
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	template <class ThisClass, typename ReturnType, typename... ArgumentTypes>
+	struct AsyncMemberFunctionGear
+	{
+		typedef ReturnType(ThisClass::*MemberFunctionPtr) (ArgumentTypes...);
+
+		typedef Internal::Async_Convert_Dispatch_Resolve::BoundMember<ThisClass, ReturnType, ArgumentTypes...> Callable;
+		typedef Internal::Async_Convert_Dispatch_Resolve::Operation<Callable, ReturnType, ArgumentTypes...> Operation;
+
+		template <MemberFunctionPtr mfptr>
+		static void Invoke(const FunctionCallbackInfo<Value>& args)
+		{
+			V8T_TRACE_GEAR(args, "AsyncMemberFunctionGear");
+
+			Isolate* iso = args.GetIsolate();
+			ThisClass* this_ptr = ClassGear<ThisClass>::UnwrapUnchecked(iso, args.Holder());
+
+			if (!this_ptr)
+			{
+				ClassGear<ThisClass>::ThrowReleased(iso);
+				return;
+			}
+
+			Callable callable = { this_ptr, mfptr };
+
+			Operation* op = new Operation(args, callable);
+			op->Retain(iso, args.Holder());
+			args.GetReturnValue().Set(op->Promise(iso));
+			op->Dispatch(iso);
+		}
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		/// <summary>
+		/// 	Binds the specified member function to the associated ClassGear, with the same requirement as
+		/// 	MemberFunctionGear::Bind that ClassGear<T>::Initialize(..) has been called first.
+		/// </summary>
+		///
+		/// <typeparam name="mfptr">	Type of the mfptr. </typeparam>
+		/// <param name="iso"> 	[in,out] If non-null, the ISO. </param>
+		/// <param name="name">	The name. </param>
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		template <MemberFunctionPtr mfptr>
+		static void Bind(Isolate* iso, const char* name)
+		{
+			Local<ObjectTemplate> protoTmpl = ClassGear<ThisClass>::PrototypeTemplate(iso);
+			Local<FunctionTemplate> lft = FunctionTemplate::New(iso, Invoke<mfptr>, Handle<Value>(), ClassGear<ThisClass>::ReceiverSignature(iso));
+			lft->SetClassName(v8::String::NewFromUtf8(iso, name));
+
+			protoTmpl->Set(v8::String::NewFromUtf8(iso, name), lft);
+		}
+	};
+}
@@ -0,0 +1,257 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+///	The MIT License (MIT)
+///
+///	Copyright (c) 2014 Gregory Hlavac
+///
+///	Permission is hereby granted, free of charge, to any person obtaining a copy
+///	of this software and associated documentation files (the "Software"), to deal
+///	in the Software without restriction, including without limitation the rights
+///	to use, copy, modify, merge, publish, distribute, sub-license, and/or sell
+///	copies of the Software, and to permit persons to whom the Software is
+///	furnished to do so, subject to the following conditions:
+///
+///	The above copyright notice and this permission notice shall be included in
+///	all copies or substantial portions of the Software.
+///
+///	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+///	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+///	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+///	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+///	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+///	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+///	THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <v8.h>
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <functional>
+#include <type_traits>
+
+#include "Common.h"
+#include "TypeConversion.h"
+
+namespace V8Transmission
+{
+	namespace Internal
+	{
+		/** Turns what a callback returned into R, a default R if it threw. */
+		template <typename R>
+		struct CallbackResult
+		{
+			static R Convert(v8::Isolate* iso, const v8::Handle<v8::Value>& value)
+			{
+				if (value.IsEmpty())
+					return R();
+
+				return ConvertFromJS<typename std::decay<R>::type>(iso, value);
+			}
+		};
+
+		template <>
+		struct CallbackResult<void>
+		{
+			static void Convert(v8::Isolate* iso, const v8::Handle<v8::Value>& value) {}
+		};
+
+		/** Enters the callback's context only if nothing is entered yet, the common case is a call from inside a gear. */
+		class CallbackContextScope
+		{
+		public:
+			CallbackContextScope(v8::Isolate* iso, const v8::Persistent<v8::Context>& context)
+			{
+				if (!iso->InContext())
+				{
+					entered = v8::Local<v8::Context>::New(iso, context);
+					entered->Enter();
+				}
+			}
+
+			~CallbackContextScope()
+			{
+				if (!entered.IsEmpty())
+					entered->Exit();
+			}
+
+		private:
+			v8::Local<v8::Context> entered;
+		};
+	}
+
+	template <typename Signature>
+	class JSCallback;
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	/// <summary>
+	/// 	A javascript function as a typed native callable, the other direction from the function gears.
+	/// 	
+	/// 	The function (and receiver) are held in persistent handles shared by every copy, so it can be
+	/// 	stored, passed on as a std::function<R(Args...)> or used as a comparator without juggling
+	/// 	handles. Each call converts the arguments with ShiftJS into an argv array sized at compile
+	/// 	time on the stack, calls the function and converts the result back with ShiftNative.
+	/// 	
+	/// 	By default calls run inside a TryCatch, a throwing callback returns R() and the exception
+	/// 	is kept for Threw/LastError. Callbacks invoked from inside a gear can turn that off with
+	/// 	catchExceptions = false, saving the TryCatch setup per call and letting the exception
+	/// 	propagate to the calling script instead; check Threw() to stop calling early.
+	/// 	
+	/// 	Calling an empty callback (no function was given) throws a TypeError into the current
+	/// 	isolate and returns R().
+	/// 	
+	/// 	Calls, copies and destruction all have to happen on the isolate's thread.
+	/// </summary>
+	///
+	/// <typeparam name="R">	Type of the return type. </typeparam>
+	/// <typeparam name="Args">	Type of the argument types. </typeparam>
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	template <typename R, typename... Args>
+	class JSCallback<R(Args...)>
+	{
+	public:
+		JSCallback() {}
+
+		JSCallback(v8::Isolate* iso, v8::Handle<v8::Function> function, bool catchExceptions = true, v8::Handle<v8::Value> receiver = v8::Handle<v8::Value>())
+			: state(std::make_shared<State>())
+		{
+			state->isolate = iso;
+			state->function.Reset(iso, function);
+			state->context.Reset(iso, function->CreationContext());
+			state->catchExceptions = catchExceptions;
+
+			if (!receiver.IsEmpty())
+				state->receiver.Reset(iso, receiver);
+		}
+
+		R operator()(Args... args) const
+		{
+			// What ShiftNative makes of a non-function argument, a gear that didn't check gets a TypeError.
+			if (!state)
+			{
+				v8::Isolate* iso = v8::Isolate::GetCurrent();
+				v8::HandleScope scope(iso);
+
+				iso->ThrowException(v8::Exception::TypeError(v8::String::NewFromUtf8(iso, "Callback is not a function")));
+
+				return Internal::CallbackResult<R>::Convert(iso, v8::Handle<v8::Value>());
+			}
+
+			State& s = *state;
+			v8::Isolate* iso = s.isolate;
+
+			v8::HandleScope scope(iso);
+			Internal::CallbackContextScope contextScope(iso, s.context);
+
+			v8::Local<v8::Function> function = v8::Local<v8::Function>::New(iso, s.function);
+			v8::Local<v8::Value> receiver = s.receiver.IsEmpty() ? v8::Local<v8::Value>(v8::Undefined(iso)) : v8::Local<v8::Value>::New(iso, s.receiver);
+
+			// One extra slot so the array isn't zero sized for callbacks without arguments.
+			v8::Handle<v8::Value> argv[sizeof...(Args) + 1] = { ConvertToJS(iso, std::forward<Args>(args))... };
+
+			if (!s.catchExceptions)
+			{
+				v8::Handle<v8::Value> result = function->Call(receiver, static_cast<int>(sizeof...(Args)), argv);
+				s.threw = result.IsEmpty();
+
+				return Internal::CallbackResult<R>::Convert(iso, result);
+			}
+
+			v8::TryCatch tryCatch;
+			v8::Handle<v8::Value> result = function->Call(receiver, static_cast<int>(sizeof...(Args)), argv);
+
+			if (tryCatch.HasCaught())
+			{
+				v8::String::Utf8Value message(tryCatch.Exception());
+
+				s.threw = true;
+				s.lastError.assign(*message ? *message : "", *message ? message.length() : 0);
+
+				return Internal::CallbackResult<R>::Convert(iso, v8::Handle<v8::Value>());
+			}
+
+			s.threw = false;
+
+			return Internal::CallbackResult<R>::Convert(iso, result);
+		}
+
+		/** True if this holds a function. */
+		explicit operator bool() const		{ return state && !state->function.IsEmpty(); }
+
+		/** Whether the last call threw (or was terminated). */
+		bool Threw() const					{ return state && state->threw; }
+
+		/** The message of the last exception caught, with catchExceptions on. Empty without a function. */
+		const std::string& LastError() const
+		{
+			static const std::string none;
+
+			return state ? state->lastError : none;
+		}
+
+		/** Does nothing without a function. */
+		void SetCatchExceptions(bool catchExceptions)
+		{
+			if (state)
+				state->catchExceptions = catchExceptions;
+		}
+
+		std::function<R(Args...)> AsFunction() const
+		{
+			return *this;
+		}
+
+	private:
+		struct State
+		{
+			v8::Isolate*				isolate;
+			v8::Persistent<v8::Function>	function;
+			v8::Persistent<v8::Value>	receiver;
+			v8::Persistent<v8::Context>	context;
+			bool						catchExceptions;
+			bool						threw;
+			std::string					lastError;
+
+			State() : isolate(nullptr), catchExceptions(true), threw(false) {}
+
+			~State()
+			{
+				function.Reset();
+				receiver.Reset();
+				context.Reset();
+			}
+		};
+
+		std::shared_ptr<State>	state;
+	};
+
+	namespace TypeConversion
+	{
+		/** Takes a javascript function argument as a JSCallback, anything else gives an empty one. */
+		template <typename R, typename... Args>
+		struct ShiftNative<JSCallback<R(Args...)> >
+		{
+			JSCallback<R(Args...)> operator()(v8::Isolate* iso, const v8::Handle<v8::Value>& val) const
+			{
+				if (!val->IsFunction())
+					return JSCallback<R(Args...)>();
+
+				return JSCallback<R(Args...)>(iso, v8::Handle<v8::Function>::Cast(val));
+			}
+		};
+
+		/** Takes a javascript function argument as a std::function, empty if it isn't one. */
+		template <typename R, typename... Args>
+		struct ShiftNative<std::function<R(Args...)> >
+		{
+			std::function<R(Args...)> operator()(v8::Isolate* iso, const v8::Handle<v8::Value>& val) const
+			{
+				if (!val->IsFunction())
+					return std::function<R(Args...)>();
+
+				return JSCallback<R(Args...)>(iso, v8::Handle<v8::Function>::Cast(val)).AsFunction();
+			}
+		};
+	}
+}
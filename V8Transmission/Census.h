@@ -0,0 +1,257 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+///	The MIT License (MIT)
+///
+///	Copyright (c) 2014 Gregory Hlavac
+///
+///	Permission is hereby granted, free of charge, to any person obtaining a copy
+///	of this software and associated documentation files (the "Software"), to deal
+///	in the Software without restriction, including without limitation the rights
+///	to use, copy, modify, merge, publish, distribute, sub-license, and/or sell
+///	copies of the Software, and to permit persons to whom the Software is
+///	furnished to do so, subject to the following conditions:
+///
+///	The above copyright notice and this permission notice shall be included in
+///	all copies or substantial portions of the Software.
+///
+///	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+///	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+///	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+///	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+///	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+///	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+///	THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <v8.h>
+
+#include <deque>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "Common.h"
+#include "ClassOptions.h"
+
+namespace V8Transmission
+{
+	/** The counters kept for one bound class in one isolate. */
+	struct ClassCensusEntry
+	{
+		const std::string*	identifier;
+
+		/** Wrappers that have been created and not yet collected. */
+		size_t				live;
+
+		/** Bytes held alive by wrappers whose ownership policy retains the object, see CO_RetainedSize<T>. */
+		size_t				retainedBytes;
+
+		uint64_t			wraps;
+		uint64_t			unwraps;
+		uint64_t			finalized;
+
+		/** Wraps and unwraps per second between the last two calls to Census::Sample. */
+		double				wrapRate;
+		double				unwrapRate;
+
+		ClassCensusEntry() : identifier(nullptr), live(0), retainedBytes(0), wraps(0), unwraps(0), finalized(0), wrapRate(0), unwrapRate(0) {}
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	/// <summary>
+	/// 	A per-isolate census of wrapped native objects, kept by ClassGear for every class with
+	/// 	CO_EnableCensus<T> enabled.
+	/// 	
+	/// 	The counters are plain integers updated from the Wrap, Unwrap and finalizer paths on the
+	/// 	isolate's thread, so reading them costs nothing compared to a heap snapshot. Bytes retained by
+	/// 	owning wrappers are also reported to V8 through AdjustAmountOfExternalAllocatedMemory, which
+	/// 	lets the collector weigh small wrappers that keep large native objects alive.
+	/// </summary>
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	class Census
+	{
+	public:
+		typedef std::chrono::steady_clock Clock;
+
+		static Census& ForIsolate(v8::Isolate* iso)
+		{
+			return IsolateData::Get(iso).Slot<Census>();
+		}
+
+		/** The counters for T in this isolate, created on first use. */
+		template <typename T>
+		static ClassCensusEntry& Of(v8::Isolate* iso)
+		{
+			Slot<T>& slot = IsolateData::Get(iso).Slot<Slot<T> >();
+
+			if (slot.entry == nullptr)
+			{
+				Census& census = ForIsolate(iso);
+
+				census.entries.push_back(ClassCensusEntry());
+				slot.entry = &census.entries.back();
+				slot.entry->identifier = CO_Identifier<T>::Value();
+			}
+
+			return *slot.entry;
+		}
+
+		/** A copy of every class' counters, with the rates updated since the previous sample. */
+		std::vector<ClassCensusEntry> Sample()
+		{
+			Clock::time_point now = Clock::now();
+			double seconds = std::chrono::duration<double>(now - lastSample).count();
+
+			std::vector<ClassCensusEntry> result;
+			result.reserve(entries.size());
+
+			lastWraps.resize(entries.size(), 0);
+			lastUnwraps.resize(entries.size(), 0);
+
+			for (size_t i = 0; i < entries.size(); i++)
+			{
+				ClassCensusEntry& entry = entries[i];
+
+				if (seconds > 0)
+				{
+					entry.wrapRate = (entry.wraps - lastWraps[i]) / seconds;
+					entry.unwrapRate = (entry.unwraps - lastUnwraps[i]) / seconds;
+				}
+
+				lastWraps[i] = entry.wraps;
+				lastUnwraps[i] = entry.unwraps;
+
+				result.push_back(entry);
+			}
+
+			lastSample = now;
+
+			return result;
+		}
+
+		/** The bytes retained by every owning wrapper in this isolate. */
+		size_t RetainedBytes() const
+		{
+			size_t total = 0;
+
+			for (size_t i = 0; i < entries.size(); i++)
+				total += entries[i].retainedBytes;
+
+			return total;
+		}
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		/// <summary>
+		/// 	Samples the census as an array of plain objects, one per class, for binding into scripts.
+		/// </summary>
+		///
+		/// <param name="iso">	[in,out] If non-null, the ISO. </param>
+		///
+		/// <returns>
+		/// 	An array of { name, live, retainedBytes, wraps, unwraps, finalized, wrapRate, unwrapRate }.
+		/// </returns>
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		static v8::Handle<v8::Array> ToJS(v8::Isolate* iso)
+		{
+			std::vector<ClassCensusEntry> sample = ForIsolate(iso).Sample();
+			v8::Handle<v8::Array> result = v8::Array::New(iso, static_cast<int>(sample.size()));
+
+			for (size_t i = 0; i < sample.size(); i++)
+			{
+				const ClassCensusEntry& entry = sample[i];
+				v8::Handle<v8::Object> obj = v8::Object::New(iso);
+
+				obj->Set(v8::String::NewFromUtf8(iso, "name"), v8::String::NewFromUtf8(iso, entry.identifier->c_str()));
+				obj->Set(v8::String::NewFromUtf8(iso, "live"), v8::Number::New(iso, static_cast<double>(entry.live)));
+				obj->Set(v8::String::NewFromUtf8(iso, "retainedBytes"), v8::Number::New(iso, static_cast<double>(entry.retainedBytes)));
+				obj->Set(v8::String::NewFromUtf8(iso, "wraps"), v8::Number::New(iso, static_cast<double>(entry.wraps)));
+				obj->Set(v8::String::NewFromUtf8(iso, "unwraps"), v8::Number::New(iso, static_cast<double>(entry.unwraps)));
+				obj->Set(v8::String::NewFromUtf8(iso, "finalized"), v8::Number::New(iso, static_cast<double>(entry.finalized)));
+				obj->Set(v8::String::NewFromUtf8(iso, "wrapRate"), v8::Number::New(iso, entry.wrapRate));
+				obj->Set(v8::String::NewFromUtf8(iso, "unwrapRate"), v8::Number::New(iso, entry.unwrapRate));
+
+				result->Set(static_cast<uint32_t>(i), obj);
+			}
+
+			return result;
+		}
+
+		/** Callback for binding the census into a template, census() in Oil Change. */
+		static void Query(const v8::FunctionCallbackInfo<v8::Value>& args)
+		{
+			args.GetReturnValue().Set(ToJS(args.GetIsolate()));
+		}
+
+		Census() : lastSample(Clock::now()) {}
+
+	private:
+		template <typename T>
+		struct Slot
+		{
+			ClassCensusEntry* entry;
+
+			Slot() : entry(nullptr) {}
+		};
+
+		// A deque so the per-class slots can keep pointing at their entry.
+		std::deque<ClassCensusEntry>	entries;
+		std::vector<uint64_t>			lastWraps;
+		std::vector<uint64_t>			lastUnwraps;
+		Clock::time_point				lastSample;
+	};
+
+	namespace Internal
+	{
+		/** Counts a new wrapper, and reports what it retains as external memory. */
+		template <typename T>
+		void CensusWrapped(v8::Isolate* iso, size_t retained)
+		{
+			ClassCensusEntry& entry = Census::Of<T>(iso);
+
+			entry.live++;
+			entry.wraps++;
+
+			if (retained != 0)
+			{
+				entry.retainedBytes += retained;
+				iso->AdjustAmountOfExternalAllocatedMemory(static_cast<int64_t>(retained));
+			}
+		}
+
+		/** Counts a collected wrapper, handing back whatever it reported when wrapped. */
+		template <typename T>
+		void CensusFinalized(v8::Isolate* iso, size_t retained)
+		{
+			ClassCensusEntry& entry = Census::Of<T>(iso);
+
+			entry.live--;
+			entry.finalized++;
+
+			if (retained != 0)
+			{
+				entry.retainedBytes -= retained;
+				iso->AdjustAmountOfExternalAllocatedMemory(-static_cast<int64_t>(retained));
+			}
+		}
+
+		/** Stops counting what a wrapper retains once its object has been taken out of it, e.g. moved to another isolate. */
+		template <typename T>
+		void CensusDisowned(v8::Isolate* iso, size_t& retained)
+		{
+			if (retained == 0)
+				return;
+
+			Census::Of<T>(iso).retainedBytes -= retained;
+			iso->AdjustAmountOfExternalAllocatedMemory(-static_cast<int64_t>(retained));
+
+			retained = 0;
+		}
+
+		template <typename T>
+		void CensusUnwrapped(v8::Isolate* iso)
+		{
+			Census::Of<T>(iso).unwraps++;
+		}
+	}
+}
@@ -25,7 +25,14 @@
 
 #include <v8.h>
 
+#include <memory>
+#include <type_traits>
+
+#include "Census.h"
 #include "ClassOptions.h"
+#include "ConstructorGears.h"
+#include "OwnershipPolicies.h"
+#include "TypeConversion.h"
 #include "FunctionGears.h"
 
 using v8::Value;
@@ -41,17 +48,45 @@ using v8::FunctionCallbackInfo;
 
 namespace V8Transmission
 {
+	namespace Internal
+	{
+		/** Holds on to whatever reference a wrapper retains, see ClassGear<T>::WrapWith. */
+		struct WrapperCellBase
+		{
+			Persistent<Object>	handle;
+
+			virtual ~WrapperCellBase() {}
+		};
+	}
+
 	template <typename NativeType, typename TypeFactory = CO_NativeTypeFactory<NativeType> >
 	struct ClassGear
 	{
-		static Persistent<FunctionTemplate>	ConstructorTemplate;
-		static Persistent<ObjectTemplate>	PrototypeTemplate;
-
 		typedef typename TypeFactory	Factory;
 
 		typedef NativeType Type;
 		typedef NativeType* TypePtr;
 
+		/** The bound class this one derives from (CO_BaseClass), void for none. */
+		typedef typename CO_BaseClass<NativeType>::Type BaseType;
+
+		typedef ObjectIsolationContext<NativeType> IsolationContext;
+
+		/** Internal field layout of every wrapper, the native pointer and the CO_Identifier<T> it was wrapped as. */
+		enum { PointerField = 0, TypeField = 1, InternalFieldCount = 2 };
+
+		/** The constructor template built for this isolate by Initialize. */
+		static Local<FunctionTemplate> ConstructorTemplate(Isolate* iso)
+		{
+			return Local<FunctionTemplate>::New(iso, Materialized(iso).ConstructorTemplate);
+		}
+
+		/** The template members are bound onto, built for this isolate by Initialize. */
+		static Local<ObjectTemplate> PrototypeTemplate(Isolate* iso)
+		{
+			return Local<ObjectTemplate>::New(iso, Materialized(iso).PrototypeTemplate);
+		}
+
 		////////////////////////////////////////////////////////////////////////////////////////////////////
 		/// <summary>
 		/// 	Initializes the initial templates properly for this ClassGear, if you don't call this before
@@ -66,48 +101,42 @@ namespace V8Transmission
 		////////////////////////////////////////////////////////////////////////////////////////////////////
 		static void Initialize(Isolate* iso)
 		{
-			// If we're enabling constructor we worry about the constructor's FunctionTemplate, otherwise
-			// we don't care at all, and we'll just instantiate the prototype template and fill it accordingly.
-			if (CO_EnableConstructor<Type>::Value)
-			{
-				Local<FunctionTemplate> ctorTemplate = FunctionTemplate::New(iso, ConstructorProxy);
-				ctorTemplate->SetClassName(v8::String::NewFromUtf8(iso, CO_Identifier<NativeType>::Value()->c_str()));
+			IsolationContext& ctx = IsolationContext::Get(iso);
 
-				if (ConstructorTemplate.IsEmpty())
-					ConstructorTemplate.Reset(iso, ctorTemplate);
+			// Every type gets a constructor FunctionTemplate, whether or not scripts can call it. Wrappers are
+			// instances of its InstanceTemplate, which is what the member gears' Signatures check receivers
+			// against, and members go on its PrototypeTemplate so all wrappers share them.
+			Local<FunctionTemplate> ctorTemplate = FunctionTemplate::New(iso, CO_EnableConstructor<Type>::Value ? ConstructorProxy : IllegalConstructor);
+			ctorTemplate->SetClassName(v8::String::NewFromUtf8(iso, CO_Identifier<NativeType>::Value()->c_str()));
 
-				Local<ObjectTemplate> protoTmpl = ctorTemplate->PrototypeTemplate();
+			Inherit(iso, ctorTemplate, std::integral_constant<bool, !std::is_void<BaseType>::value>());
 
-				// Check if we need to be able to set a second internal field that corresponds to
-				// the bound types native 'type' that assists with casting, unsure as of yet how
-				// to handle doing this with a derived type casting situation but it'll be investigated
-				// at a later date when it is needed.
-				if (CO_ExplicitTypeCheck<Type>::Value)
-					protoTmpl->SetInternalFieldCount(2);
-				else
-					protoTmpl->SetInternalFieldCount(1);
+			Local<ObjectTemplate> instTmpl = ctorTemplate->InstanceTemplate();
 
-				if (PrototypeTemplate.IsEmpty())
-					PrototypeTemplate.Reset(iso, protoTmpl);
-			}
-			else
+			// The second internal field always carries the bound type's identifier, it is what
+			// CO_ExplicitTypeCheck checks against and how the IsolateTransfer tells bound types apart.
+			instTmpl->SetInternalFieldCount(InternalFieldCount);
+
+			if (ctx.ConstructorTemplate.IsEmpty())
 			{
-				Local<ObjectTemplate> protoTmpl = ObjectTemplate::New(iso);
-
-				// Check if we need to be able to set a second internal field that corresponds to
-				// the bound types native 'type' that assists with casting, unsure as of yet how
-				// to handle doing this with a derived type casting situation but it'll be investigated
-				// at a later date when it is needed.
-				if (CO_ExplicitTypeCheck<Type>::Value)
-					protoTmpl->SetInternalFieldCount(2);
-				else
-					protoTmpl->SetInternalFieldCount(1);
-
-				if (PrototypeTemplate.IsEmpty())
-					PrototypeTemplate.Reset(iso, protoTmpl);
+				ctx.ConstructorTemplate.Reset(iso, ctorTemplate);
+				ctx.InstanceTemplate.Reset(iso, instTmpl);
+				ctx.PrototypeTemplate.Reset(iso, ctorTemplate->PrototypeTemplate());
 			}
 		}
 
+		/** Rejects receivers that aren't wrappers of this type, for FunctionTemplate::New on member functions. */
+		static Local<v8::Signature> ReceiverSignature(Isolate* iso)
+		{
+			return v8::Signature::New(iso, ConstructorTemplate(iso));
+		}
+
+		/** Rejects receivers that aren't wrappers of this type, for SetAccessor on member variables. Pass info.This() on, Holder() is the prototype. */
+		static Local<v8::AccessorSignature> ReceiverAccessorSignature(Isolate* iso)
+		{
+			return v8::AccessorSignature::New(iso, ConstructorTemplate(iso));
+		}
+
 		////////////////////////////////////////////////////////////////////////////////////////////////////
 		/// <summary>
 		/// 	Binds the constructor template into the scope of the specified object template, this does
@@ -125,15 +154,31 @@ namespace V8Transmission
 			// Once again, we don't bind a type if it doesn't have a constructor.
 			if (CO_EnableConstructor<Type>::Value)
 			{
-				Local<FunctionTemplate> ctorTemplate = Local<FunctionTemplate>::New(iso, ConstructorTemplate);
+				Local<FunctionTemplate> ctorTemplate = ConstructorTemplate(iso);
 				tmpl->Set(iso, CO_Identifier<NativeType>::Value()->c_str(), ctorTemplate);
 			}
 		}
 
+		static void IllegalConstructor(const FunctionCallbackInfo<Value>& arguments)
+		{
+			Isolate* iso = arguments.GetIsolate();
+			iso->ThrowException(v8::Exception::TypeError(v8::String::NewFromUtf8(iso, "Illegal constructor")));
+		}
+
 		static void ConstructorProxy(const FunctionCallbackInfo<Value>& arguments)
 		{
 			TypePtr new_object = Factory::Construct(arguments);
-			arguments.GetReturnValue().Set(Wrap(arguments.GetIsolate(), new_object));
+
+			// No constructor took these arguments, the factory has thrown.
+			if (new_object == nullptr)
+				return;
+
+			// With CO_EnableSmartPointerGC the JS object owns what it constructed and hands it back to the
+			// factory once collected, otherwise the native side is expected to clean it up.
+			if (CO_EnableSmartPointerGC<Type>::Value)
+				arguments.GetReturnValue().Set(WrapWith<Ownership::FactoryOwned<NativeType, Factory> >(arguments.GetIsolate(), new_object));
+			else
+				arguments.GetReturnValue().Set(Wrap(arguments.GetIsolate(), new_object));
 		}
 
 		////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -154,17 +199,103 @@ namespace V8Transmission
 		////////////////////////////////////////////////////////////////////////////////////////////////////
 		static Handle<Object> Wrap(Isolate* iso, TypePtr native_ptr)
 		{
-			Local<ObjectTemplate> tmpl = Local<ObjectTemplate>::New(iso, PrototypeTemplate);
-			Handle<Object> result = tmpl->NewInstance();
+			// Counting the wrapper's collection needs a weak handle on it, which WrapWith sets up.
+			if (CO_EnableCensus<Type>::Value)
+				return WrapWith<Ownership::Borrowed<NativeType> >(iso, native_ptr);
 
-			Handle<External> internal_ptr = v8::External::New(iso, native_ptr);
-			result->SetInternalField(0, internal_ptr);
+			return NewWrapper(iso, native_ptr);
+		}
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		/// <summary>
+		/// 	Wraps a natively owned object, ownership moves into the returned JS object and the native
+		/// 	object is deleted once that has been garbage collected.
+		/// </summary>
+		///
+		/// <param name="iso">  	[in,out] If non-null, the ISO. </param>
+		/// <param name="owned">	The object to hand over to javascript. </param>
+		///
+		/// <returns>
+		/// 	A Handle&lt;Object&gt;
+		/// </returns>
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		static Handle<Object> Wrap(Isolate* iso, std::unique_ptr<NativeType>&& owned)
+		{
+			return WrapWith<Ownership::Unique<NativeType> >(iso, std::move(owned));
+		}
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		/// <summary>
+		/// 	Wraps an object shared with native subsystems, the JS object holds one reference on it for as
+		/// 	long as it is alive so neither side has to copy it.
+		/// </summary>
+		///
+		/// <param name="iso">   	[in,out] If non-null, the ISO. </param>
+		/// <param name="shared">	The shared object. </param>
+		///
+		/// <returns>
+		/// 	A Handle&lt;Object&gt;
+		/// </returns>
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		static Handle<Object> Wrap(Isolate* iso, const std::shared_ptr<NativeType>& shared)
+		{
+			return WrapWith<Ownership::Shared<NativeType> >(iso, shared);
+		}
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		/// <summary>
+		/// 	Wraps an intrusively reference counted object, adding a reference through
+		/// 	CO_IntrusiveRefCount<T> that is dropped again once the JS object has been collected.
+		/// </summary>
+		///
+		/// <param name="iso">	  	[in,out] If non-null, the ISO. </param>
+		/// <param name="native_ptr">	The native pointer. </param>
+		///
+		/// <returns>
+		/// 	A Handle&lt;Object&gt;
+		/// </returns>
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		static Handle<Object> WrapRetained(Isolate* iso, TypePtr native_ptr)
+		{
+			return WrapWith<Ownership::Intrusive<NativeType> >(iso, Ownership::Intrusive<NativeType>::Acquire(native_ptr));
+		}
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		/// <summary>
+		/// 	Wraps a reference under the given ownership policy (see OwnershipPolicies.h). Policies that
+		/// 	retain the object move the reference into a heap allocated cell alongside the wrapper's weak
+		/// 	handle and release it from the weak callback.
+		/// </summary>
+		///
+		/// <typeparam name="Policy">	The ownership policy. </typeparam>
+		/// <param name="iso">	[in,out] If non-null, the ISO. </param>
+		/// <param name="ref">	The reference to hand over. </param>
+		///
+		/// <returns>
+		/// 	A Handle&lt;Object&gt;
+		/// </returns>
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		template <typename Policy>
+		static Handle<Object> WrapWith(Isolate* iso, typename Policy::Reference ref)
+		{
+			TypePtr native_ptr = Policy::Get(ref);
+			Handle<Object> result = NewWrapper(iso, native_ptr);
 
-			// If we need explicit type checking, set the external correctly.
-			if (CO_ExplicitTypeCheck<Type>::Value)
+			if (Policy::Retains || CO_EnableCensus<Type>::Value)
 			{
-				Handle<External> type_ptr = v8::External::New(iso, CO_Identifier<NativeType>::Value);
-				result->SetInternalField(1, type_ptr);
+				WrapperCell<Policy>* cell = new WrapperCell<Policy>(std::move(ref));
+				cell->handle.Reset(iso, result);
+				cell->handle.SetWeak(cell, ReleaseCell<Policy>);
+
+				if (CO_EnableCensus<Type>::Value)
+				{
+					cell->retained = Policy::Retains && native_ptr != nullptr ? CO_RetainedSize<NativeType>::Of(native_ptr) : 0;
+					Internal::CensusWrapped<NativeType>(iso, cell->retained);
+				}
+
+				// Kept on the object so ownership can be taken back out of it, see IsolateTransfer.h.
+				if (Policy::Retains)
+					result->SetHiddenValue(CellKey(iso), v8::External::New(iso, static_cast<Internal::WrapperCellBase*>(cell)));
 			}
 
 			return result;
@@ -187,27 +318,214 @@ namespace V8Transmission
 		////////////////////////////////////////////////////////////////////////////////////////////////////
 		static TypePtr Unwrap(Isolate* iso, Handle<Value> obj)
 		{
-			Handle<External> field = Handle<External>::Cast(obj->ToObject()->GetInternalField(0));
+			if (obj.IsEmpty() || !obj->IsObject())
+				return nullptr;
 
-			if (CO_ExplicitTypeCheck<Type>::Value)
-			{
-				Handle<External> typeField = Handle<External>::Cast(obj->ToObject()->GetInternalField(1));
+			Handle<Object> wrapper = Handle<Object>::Cast(obj);
+
+			if (wrapper->InternalFieldCount() < InternalFieldCount)
+				return nullptr;
 
-				std::string* tptr = static_cast<std::string*>(typeField->Value());
+			Handle<External> field = Handle<External>::Cast(wrapper->GetInternalField(PointerField));
+			Handle<External> typeField = Handle<External>::Cast(wrapper->GetInternalField(TypeField));
 
-				if (tptr != CO_Identifier<Type>::Value())
+			const std::string* tptr = static_cast<const std::string*>(typeField->Value());
+			void* ptr = field->Value();
+
+			// A wrapper of a derived class has its pointer adjusted to this type, anything else unrelated
+			// is only refused when CO_ExplicitTypeCheck asks for it.
+			if (tptr != CO_Identifier<Type>::Value())
+			{
+				Internal::UpcastFunction upcast = Internal::ClassHierarchy::Find(tptr, CO_Identifier<Type>::Value());
+
+				if (upcast != nullptr)
+					ptr = upcast(ptr);
+				else if (CO_ExplicitTypeCheck<Type>::Value)
 					return nullptr;
 			}
 
+			if (CO_EnableCensus<Type>::Value)
+				Internal::CensusUnwrapped<NativeType>(iso);
+
+			return static_cast<TypePtr>(ptr);
+		}
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		/// <summary>
+		/// 	Unwraps a receiver V8 has already checked against ReceiverSignature/ReceiverAccessorSignature,
+		/// 	skipping every check Unwrap makes. Only use it from callbacks bound with one of those, on
+		/// 	args.Holder() in functions and info.This() in accessors. An accessor's Holder() is the
+		/// 	prototype it was set on, which has no internal fields.
+		/// 	
+		/// 	Still returns nullptr for a wrapper whose object was moved out by the IsolateTransfer, and
+		/// 	for one of a derived type with no registered upcast.
+		/// </summary>
+		///
+		/// <param name="iso">   	[in,out] If non-null, the ISO. </param>
+		/// <param name="holder">	The holder. </param>
+		///
+		/// <returns>
+		/// 	A TypePtr.
+		/// </returns>
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		static TypePtr UnwrapUnchecked(Isolate* iso, const Handle<Object>& holder)
+		{
+			if (CO_EnableCensus<Type>::Value)
+				Internal::CensusUnwrapped<NativeType>(iso);
+
+			void* ptr = Handle<External>::Cast(holder->GetInternalField(PointerField))->Value();
+			const std::string* tptr = static_cast<const std::string*>(Handle<External>::Cast(holder->GetInternalField(TypeField))->Value());
+
+			// The Signature lets wrappers of derived classes through, their pointer needs adjusting to this type.
+			// One wrapped before Inherit registered the upcast has none, and is treated as released.
+			if (tptr != CO_Identifier<Type>::Value())
+			{
+				Internal::UpcastFunction upcast = Internal::ClassHierarchy::Find(tptr, CO_Identifier<Type>::Value());
+
+				if (upcast == nullptr)
+					return nullptr;
+
+				ptr = upcast(ptr);
+			}
 
-			void* ptr = field->Value();
 			return static_cast<TypePtr>(ptr);
 		}
+
+		/** Throws for a call on a wrapper UnwrapUnchecked found empty. */
+		static void ThrowReleased(Isolate* iso)
+		{
+			iso->ThrowException(v8::Exception::Error(v8::String::NewFromUtf8(iso, "Native object is no longer available")));
+		}
+
+		/** The hidden value key a retaining wrapper keeps its WrapperCell under. */
+		static Handle<v8::String> CellKey(Isolate* iso)
+		{
+			return v8::String::NewFromUtf8(iso, "V8Transmission::WrapperCell", v8::String::kInternalizedString);
+		}
+
+		/** Ties the reference a wrapper retains to that wrapper's weak handle. */
+		template <typename Policy>
+		struct WrapperCell : Internal::WrapperCellBase
+		{
+			typename Policy::Reference	ref;
+
+			/** What the census counted this wrapper as retaining, given back when it is collected. */
+			size_t						retained;
+
+			explicit WrapperCell(typename Policy::Reference&& ref) : ref(std::move(ref)), retained(0) {}
+		};
+
+	private:
+
+		/** Instantiates a wrapper and fills in its internal fields, with no ownership or census bookkeeping. */
+		static Handle<Object> NewWrapper(Isolate* iso, TypePtr native_ptr)
+		{
+			Local<ObjectTemplate> tmpl = Local<ObjectTemplate>::New(iso, Materialized(iso).InstanceTemplate);
+			Handle<Object> result = tmpl->NewInstance();
+
+			Handle<External> internal_ptr = v8::External::New(iso, native_ptr);
+			result->SetInternalField(PointerField, internal_ptr);
+
+			Handle<External> type_ptr = v8::External::New(iso, CO_Identifier<NativeType>::Value());
+			result->SetInternalField(TypeField, type_ptr);
+
+			return result;
+		}
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		/// <summary>
+		/// 	Makes the constructor template inherit the base's, so base members live once on the base
+		/// 	prototype, and registers the cast to every ancestor with the ClassHierarchy.
+		/// </summary>
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		static void Inherit(Isolate* iso, Local<FunctionTemplate> ctorTemplate, std::true_type)
+		{
+			Local<FunctionTemplate> baseTemplate = ClassGear<BaseType>::ConstructorTemplate(iso);
+
+			// Neither initialized nor registered, this at least keeps the chain intact for its members.
+			if (baseTemplate.IsEmpty())
+			{
+				ClassGear<BaseType>::Initialize(iso);
+				baseTemplate = ClassGear<BaseType>::ConstructorTemplate(iso);
+			}
+
+			ctorTemplate->Inherit(baseTemplate);
+
+			RegisterUpcasts<BaseType>(std::true_type());
+		}
+
+		static void Inherit(Isolate* iso, Local<FunctionTemplate> ctorTemplate, std::false_type) {}
+
+		template <typename Ancestor>
+		static void RegisterUpcasts(std::true_type)
+		{
+			typedef typename CO_BaseClass<Ancestor>::Type Next;
+
+			Internal::ClassHierarchy::Register(CO_Identifier<NativeType>::Value(), CO_Identifier<Ancestor>::Value(), &UpcastTo<Ancestor>);
+			RegisterUpcasts<Next>(std::integral_constant<bool, !std::is_void<Next>::value>());
+		}
+
+		template <typename Ancestor>
+		static void RegisterUpcasts(std::false_type) {}
+
+		template <typename Ancestor>
+		static void* UpcastTo(void* ptr)
+		{
+			return static_cast<Ancestor*>(static_cast<NativeType*>(ptr));
+		}
+
+		/** The isolate's context, built first if the type was registered lazily and hasn't been used yet. */
+		static IsolationContext& Materialized(Isolate* iso)
+		{
+			IsolationContext& ctx = IsolationContext::Get(iso);
+
+			if (ctx.PrototypeTemplate.IsEmpty() && ctx.Materialize != nullptr)
+				ctx.Materialize(iso);
+
+			return ctx;
+		}
+
+		template <typename Policy>
+		static void ReleaseCell(const v8::WeakCallbackData<Object, WrapperCell<Policy> >& data)
+		{
+			WrapperCell<Policy>* cell = data.GetParameter();
+
+			if (CO_EnableCensus<Type>::Value)
+				Internal::CensusFinalized<NativeType>(data.GetIsolate(), cell->retained);
+
+			Policy::Release(cell->ref);
+			cell->handle.Reset();
+
+			delete cell;
+		}
 	};
 
-	template <typename NativeType, typename TypeFactory>
-	Persistent<FunctionTemplate> V8Transmission::ClassGear<NativeType, TypeFactory>::ConstructorTemplate;
+	namespace TypeConversion
+	{
+		/** Returning a std::unique_ptr<T> hands the object over to javascript, see ClassGear::Wrap. */
+		template <typename NativeType>
+		struct ShiftJS<std::unique_ptr<NativeType> >
+		{
+			ValueHandle operator()(v8::Isolate* iso, std::unique_ptr<NativeType>&& v) const
+			{
+				if (!v)
+					return v8::Null(iso);
 
-	template <typename NativeType, typename TypeFactory>
-	Persistent<ObjectTemplate> V8Transmission::ClassGear<NativeType, TypeFactory>::PrototypeTemplate;
+				return ClassGear<NativeType>::Wrap(iso, std::move(v));
+			}
+		};
+
+		/** Returning a std::shared_ptr<T> shares the object with javascript without copying it. */
+		template <typename NativeType>
+		struct ShiftJS<std::shared_ptr<NativeType> >
+		{
+			ValueHandle operator()(v8::Isolate* iso, const std::shared_ptr<NativeType>& v) const
+			{
+				if (!v)
+					return v8::Null(iso);
+
+				return ClassGear<NativeType>::Wrap(iso, v);
+			}
+		};
+	}
 }
\ No newline at end of file
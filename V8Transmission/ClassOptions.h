@@ -48,7 +48,9 @@ namespace V8Transmission
 	/// 	A ClassOption to enable a primitive form of garbage collection for a class to track javascript
 	/// 	side classes that were instantiated and linked to a native class.
 	/// 	
-	/// 	This isn't implemented yet, but will likely utilize std::shared_ptr and weak_ptr.
+	/// 	When enabled, objects created through the JS constructor are owned by their wrapper and are
+	/// 	handed back to the TypeFactory's Destruct once it has been collected (Ownership::FactoryOwned).
+	/// 	Objects wrapped from native code choose their own policy through ClassGear<T>::WrapWith.
 	/// </summary>
 	///
 	/// <typeparam name="T">	Generic type parameter. </typeparam>
@@ -68,6 +70,38 @@ namespace V8Transmission
 	template <typename T>
 	struct CO_ExplicitTypeCheck : Boolean_Option<false> {};
 
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	/// <summary>
+	/// 	A ClassOption to keep a per-isolate census of this class' wrappers (see Census.h), live
+	/// 	instances, retained bytes and wrap/unwrap counts.
+	/// 	
+	/// 	Every wrapper gets a weak handle so its collection can be counted, including ones that only
+	/// 	borrow the native object, so leave it off for classes wrapped in large numbers.
+	/// </summary>
+	///
+	/// <typeparam name="T">	Generic type parameter. </typeparam>
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	template <typename T>
+	struct CO_EnableCensus : Boolean_Option<false> {};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	/// <summary>
+	/// 	A ClassOption giving the native memory an object of this class keeps alive, sizeof(T) unless
+	/// 	specialized. Counted by the census and reported to V8 as external memory for wrappers that
+	/// 	own their object.
+	/// </summary>
+	///
+	/// <typeparam name="T">	Generic type parameter. </typeparam>
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	template <typename T>
+	struct CO_RetainedSize
+	{
+		static size_t Of(const T* obj)
+		{
+			return sizeof(T);
+		}
+	};
+
 	////////////////////////////////////////////////////////////////////////////////////////////////////
 	/// <summary>
 	/// 	A ClassOption to enable constructing this object, keep in mind this does not disqualify you
@@ -108,11 +142,80 @@ namespace V8Transmission
 		}
 	};
 
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	/// <summary>
+	/// 	A ClassOption naming the bound class this one derives from, void for none. The derived
+	/// 	ClassGear's constructor template then inherits the base's, so base members bound once on
+	/// 	the base prototype work on derived wrappers with the native pointer adjusted to the base.
+	/// 	
+	/// 	template <>
+	/// 	struct CO_BaseClass<Player>
+	/// 	{
+	/// 		typedef Entity Type;
+	/// 	};
+	/// 	
+	/// 	The base has to be initialized (or registered with V8T_REGISTER_CLASS) along with the
+	/// 	derived class, its members are only bound by its own ClassMembers or Bind calls.
+	/// </summary>
+	///
+	/// <typeparam name="T">	Generic type parameter. </typeparam>
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	template <typename T>
+	struct CO_BaseClass
+	{
+		typedef void Type;
+	};
+
+	template <typename T, typename... Args>
+	struct ConstructorGear;
+
+	namespace Internal
+	{
+		template <typename T>
+		struct ObjectStorage;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	/// <summary>
+	/// 	A ClassOption listing the constructors the JS constructor can call, either a single
+	/// 	ConstructorGear or a ConstructorOverloads of several (see ConstructorGears.h).
+	/// 	
+	/// 	By default this only calls the no argument constructor of the type.
+	/// 	
+	/// 	template <>
+	/// 	struct CO_Constructors<Point>
+	/// 	{
+	/// 		typedef ConstructorOverloads<ConstructorGear<Point>, ConstructorGear<Point, double, double> > Type;
+	/// 	};
+	/// </summary>
+	///
+	/// <typeparam name="T">	Generic type parameter. </typeparam>
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	template <typename T>
+	struct CO_Constructors
+	{
+		typedef ConstructorGear<T> Type;
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	/// <summary>
+	/// 	A ClassOption to keep objects made by the default factory in fixed size slots carved out of
+	/// 	blocks the library keeps for the life of the process, rather than one heap allocation each.
+	/// 	Only for small trivially destructible types, and only when every object of the type that is
+	/// 	handed back to the factory's Destruct was made by its Construct.
+	/// </summary>
+	///
+	/// <typeparam name="T">	Generic type parameter. </typeparam>
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	template <typename T>
+	struct CO_InlineStorage : Boolean_Option<false> {};
+
 	////////////////////////////////////////////////////////////////////////////////////////////////////
 	/// <summary>
 	///		Base policy template used by the wrapper to create objects from JS arguments.
 	///		
-	///		By default this only calls the no argument constructor of the type.
+	///		Constructs whichever of CO_Constructors<T> matches the arguments in place, into storage
+	///		from Allocate, and Destruct hands that storage back.
 	/// </summary>
 	///
 	/// <typeparam name="T">	Generic type parameter. </typeparam>
@@ -124,12 +227,26 @@ namespace V8Transmission
 
 		static ReturnType Construct(const v8::FunctionCallbackInfo<v8::Value>& arguments)
 		{
-			return new T;
+			return CO_Constructors<T>::Type::template Construct<CO_NativeTypeFactory>(arguments);
+		}
+
+		static void* Allocate()
+		{
+			return Internal::ObjectStorage<T>::Allocate();
+		}
+
+		static void Deallocate(void* storage)
+		{
+			Internal::ObjectStorage<T>::Deallocate(storage);
 		}
 
 		static void Destruct(ReturnType obj)
 		{
-			delete obj;
+			if (obj == nullptr)
+				return;
+
+			obj->~T();
+			Deallocate(obj);
 		}
 	};
-}
\ No newline at end of file
+}
@@ -0,0 +1,233 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+///	The MIT License (MIT)
+///
+///	Copyright (c) 2014 Gregory Hlavac
+///
+///	Permission is hereby granted, free of charge, to any person obtaining a copy
+///	of this software and associated documentation files (the "Software"), to deal
+///	in the Software without restriction, including without limitation the rights
+///	to use, copy, modify, merge, publish, distribute, sub-license, and/or sell
+///	copies of the Software, and to permit persons to whom the Software is
+///	furnished to do so, subject to the following conditions:
+///
+///	The above copyright notice and this permission notice shall be included in
+///	all copies or substantial portions of the Software.
+///
+///	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+///	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+///	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+///	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+///	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+///	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+///	THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <v8.h>
+
+#include <deque>
+#include <mutex>
+#include <string>
+
+#include "Common.h"
+#include "ClassGears.h"
+
+using v8::Local;
+using v8::Handle;
+using v8::String;
+using v8::Isolate;
+using v8::External;
+using v8::ObjectTemplate;
+using v8::FunctionTemplate;
+
+#define V8T_REGISTRY_CONCAT_(A, B) A##B
+#define V8T_REGISTRY_CONCAT(A, B) V8T_REGISTRY_CONCAT_(A, B)
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// <summary>
+/// 	Adds a ClassGear bound type to ClassRegistry::Shared() during static initialization, its
+/// 	members come from the ClassMembers<Type> specialization.
+/// 	
+/// 	V8T_REGISTER_CLASS(RandomCrap)
+/// </summary>
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#define V8T_REGISTER_CLASS(Type) \
+	static ::V8Transmission::ClassRegistration<Type> V8T_REGISTRY_CONCAT(v8tClassRegistration_, __COUNTER__);
+
+namespace V8Transmission
+{
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	/// <summary>
+	/// 	The members of a registered class, specialize it with a static Bind that makes the same gear
+	/// 	Bind calls you would otherwise make right after ClassGear<T>::Initialize.
+	/// 	
+	/// 	template <> struct ClassMembers<RandomCrap>
+	/// 	{
+	/// 		static void Bind(Isolate* iso)
+	/// 		{
+	/// 			MemberFunctionGear<RandomCrap, int, std::string>::Bind<&RandomCrap::XPrint>(iso, "xPrint");
+	/// 		}
+	/// 	};
+	/// </summary>
+	///
+	/// <typeparam name="T">	Generic type parameter. </typeparam>
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	template <typename T>
+	struct ClassMembers
+	{
+		static void Bind(Isolate* iso) {}
+	};
+
+	namespace Internal
+	{
+		/** Builds the templates of a registered class for this isolate, once. */
+		template <typename T>
+		void MaterializeClass(Isolate* iso)
+		{
+			ObjectIsolationContext<T>& ctx = ObjectIsolationContext<T>::Get(iso);
+
+			if (!ctx.PrototypeTemplate.IsEmpty())
+				return;
+
+			ClassGear<T>::Initialize(iso);
+			ClassMembers<T>::Bind(iso);
+		}
+
+		template <typename T>
+		Local<FunctionTemplate> RegisteredConstructor(Isolate* iso)
+		{
+			return ClassGear<T>::ConstructorTemplate(iso);
+		}
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	/// <summary>
+	/// 	A list of bound classes whose templates are only built once a script first touches them.
+	/// 	
+	/// 	Bind only puts one accessor per constructor on the global template. The first read of that
+	/// 	property builds the class' templates for the isolate (ClassGear<T>::Initialize followed by
+	/// 	ClassMembers<T>::Bind) and replaces the accessor with the constructor itself, so every later
+	/// 	read is a plain property load. Wrapping an instance natively before the constructor was ever
+	/// 	touched builds the templates just the same, through the ObjectIsolationContext hook.
+	/// 	
+	/// 	BindEager builds everything up front instead, for comparison or for snapshots.
+	/// </summary>
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	class ClassRegistry
+	{
+	public:
+		struct Entry
+		{
+			std::string*				(*identifier)();
+			bool						constructible;
+			void						(*materialize)(Isolate*);
+			Local<FunctionTemplate>		(*constructor)(Isolate*);
+			void						(*hook)(Isolate*, void(*)(Isolate*));
+		};
+
+		/** The registry V8T_REGISTER_CLASS adds to. */
+		static ClassRegistry& Shared()
+		{
+			static ClassRegistry registry;
+
+			return registry;
+		}
+
+		template <typename T>
+		void Add()
+		{
+			Entry entry;
+			entry.identifier = &CO_Identifier<T>::Value;
+			entry.constructible = CO_EnableConstructor<T>::Value;
+			entry.materialize = &Internal::MaterializeClass<T>;
+			entry.constructor = &Internal::RegisteredConstructor<T>;
+			entry.hook = &InstallHook<T>;
+
+			std::lock_guard<std::mutex> lock(mutex);
+			entries.push_back(entry);
+		}
+
+		size_t Size() const
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			return entries.size();
+		}
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		/// <summary>
+		/// 	Installs a lazy accessor for every registered constructor on the global template, nothing
+		/// 	is built for the classes themselves until they are used.
+		/// </summary>
+		///
+		/// <param name="iso">   	[in,out] If non-null, the ISO. </param>
+		/// <param name="global">	The global template. </param>
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		void Bind(Isolate* iso, const Handle<ObjectTemplate>& global)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			for (std::deque<Entry>::iterator it = entries.begin(); it != entries.end(); ++it)
+			{
+				it->hook(iso, it->materialize);
+
+				if (it->constructible)
+					global->SetAccessor(String::NewFromUtf8(iso, it->identifier()->c_str()), LazyGetter, LazySetter, External::New(iso, &*it));
+			}
+		}
+
+		/** Builds every registered class and binds its constructor right away. */
+		void BindEager(Isolate* iso, const Handle<ObjectTemplate>& global)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			for (std::deque<Entry>::iterator it = entries.begin(); it != entries.end(); ++it)
+			{
+				it->materialize(iso);
+
+				if (it->constructible)
+					global->Set(String::NewFromUtf8(iso, it->identifier()->c_str()), it->constructor(iso));
+			}
+		}
+
+	private:
+		template <typename T>
+		static void InstallHook(Isolate* iso, void(*materialize)(Isolate*))
+		{
+			ObjectIsolationContext<T>::Get(iso).Materialize = materialize;
+		}
+
+		static void LazyGetter(Local<String> property, const v8::PropertyCallbackInfo<v8::Value>& info)
+		{
+			Entry* entry = static_cast<Entry*>(Local<External>::Cast(info.Data())->Value());
+			Isolate* iso = info.GetIsolate();
+
+			entry->materialize(iso);
+
+			Local<v8::Function> ctor = entry->constructor(iso)->GetFunction();
+
+			// Swap the accessor for the constructor so later reads don't come back through here.
+			info.Holder()->ForceSet(property, ctor);
+			info.GetReturnValue().Set(ctor);
+		}
+
+		static void LazySetter(Local<String> property, Local<v8::Value> value, const v8::PropertyCallbackInfo<void>& info)
+		{
+			info.Holder()->ForceSet(property, value);
+		}
+
+		// A deque so entries keep their address, the accessors point straight at them.
+		std::deque<Entry>	entries;
+		mutable std::mutex	mutex;
+	};
+
+	/** Registers T with ClassRegistry::Shared() when constructed, see V8T_REGISTER_CLASS. */
+	template <typename T>
+	struct ClassRegistration
+	{
+		ClassRegistration()
+		{
+			ClassRegistry::Shared().Add<T>();
+		}
+	};
+}
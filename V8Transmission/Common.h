@@ -25,6 +25,28 @@
 
 #include <v8.h>
 
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <utility>
+#include <unordered_map>
+#include <stdint.h>
+#include <type_traits>
+
+#if !defined(V8T_ISOLATE_DATA_SLOT)
+#	define V8T_ISOLATE_DATA_SLOT 0
+#endif
+
+// True when building against at least the given V8 version, for APIs newer than the baseline this
+// was written against. V8 headers too old to define V8_MAJOR_VERSION count as older than any.
+#if defined(V8_MAJOR_VERSION) && defined(V8_MINOR_VERSION)
+#	define V8T_V8_AT_LEAST(major, minor) (V8_MAJOR_VERSION > (major) || (V8_MAJOR_VERSION == (major) && V8_MINOR_VERSION >= (minor)))
+#else
+#	define V8T_V8_AT_LEAST(major, minor) 0
+#endif
+
 namespace V8Transmission
 {
 	template <bool Condition>
@@ -37,6 +59,13 @@ namespace V8Transmission
 
 	typedef v8::Handle<v8::Value> ValueHandle;
 
+	// Defined in V8Transmission.h, declared here so the conversion helpers are visible to every gear.
+	template <typename T>
+	v8::Handle<v8::Value> ConvertToJS(v8::Isolate* iso, T&& v);
+
+	template <typename NT>
+	NT ConvertFromJS(v8::Isolate* iso, v8::Handle<v8::Value> v);
+
 	template <typename Type, Type Val>
 	struct Static_Option
 	{
@@ -49,12 +78,218 @@ namespace V8Transmission
 	template <int Val>
 	struct Integer_Option : Static_Option<int, Val> {};
 
+	namespace Internal
+	{
+		/** A compile-time list of indices, used to expand a std::tuple back into an argument pack. */
+		template <int... Indices>
+		struct IndexList {};
+
+		template <int N, int... Indices>
+		struct BuildIndexList : BuildIndexList<N - 1, N - 1, Indices...> {};
+
+		template <int... Indices>
+		struct BuildIndexList<0, Indices...>
+		{
+			typedef IndexList<Indices...> Type;
+		};
+	}
+
+	namespace Internal
+	{
+		/** The typed array kind matching a numeric element type, not defined for types without one. */
+		template <typename T> struct TypedArrayFor;
+
+		template <> struct TypedArrayFor<int8_t>	{ typedef v8::Int8Array Type; };
+		template <> struct TypedArrayFor<uint8_t>	{ typedef v8::Uint8Array Type; };
+		template <> struct TypedArrayFor<int16_t>	{ typedef v8::Int16Array Type; };
+		template <> struct TypedArrayFor<uint16_t>	{ typedef v8::Uint16Array Type; };
+		template <> struct TypedArrayFor<int32_t>	{ typedef v8::Int32Array Type; };
+		template <> struct TypedArrayFor<uint32_t>	{ typedef v8::Uint32Array Type; };
+		template <> struct TypedArrayFor<float>		{ typedef v8::Float32Array Type; };
+		template <> struct TypedArrayFor<double>	{ typedef v8::Float64Array Type; };
+
+		template <typename T, typename Enable = void>
+		struct HasTypedArray : std::false_type {};
+
+		template <typename T>
+		struct HasTypedArray<T, typename std::enable_if<sizeof(typename TypedArrayFor<T>::Type) != 0>::type> : std::true_type {};
+	}
+
+	namespace Internal
+	{
+		/** Hands out a process wide slot index for every type that keeps per-isolate state. */
+		inline int NextIsolationSlot()
+		{
+			static std::atomic<int> next(0);
+
+			return next++;
+		}
+
+		template <typename T>
+		struct IsolationSlot
+		{
+			static int Value()
+			{
+				static const int slot = NextIsolationSlot();
+
+				return slot;
+			}
+		};
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	/// <summary>
+	/// 	Everything V8Transmission keeps per isolate, hung off the isolate's data slot
+	/// 	V8T_ISOLATE_DATA_SLOT (define it before including V8Transmission if slot 0 is taken).
+	/// 	
+	/// 	Each type that needs per-isolate state gets a fixed slot index, so looking it up is two
+	/// 	loads rather than a map search.
+	/// </summary>
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	class IsolateData
+	{
+	public:
+		static IsolateData& Get(v8::Isolate* iso)
+		{
+			IsolateData* data = static_cast<IsolateData*>(iso->GetData(V8T_ISOLATE_DATA_SLOT));
+
+			if (data == nullptr)
+			{
+				data = new IsolateData;
+				iso->SetData(V8T_ISOLATE_DATA_SLOT, data);
+			}
+
+			return *data;
+		}
+
+		/** Frees everything kept for the isolate, call it before disposing of the isolate. */
+		static void Dispose(v8::Isolate* iso)
+		{
+			IsolateData* data = static_cast<IsolateData*>(iso->GetData(V8T_ISOLATE_DATA_SLOT));
+
+			if (data == nullptr)
+				return;
+
+			for (size_t i = 0; i < data->slots.size(); i++)
+			{
+				if (data->slots[i] != nullptr)
+					data->deleters[i](data->slots[i]);
+			}
+
+			iso->SetData(V8T_ISOLATE_DATA_SLOT, nullptr);
+			delete data;
+		}
+
+		template <typename T>
+		T& Slot()
+		{
+			size_t index = static_cast<size_t>(Internal::IsolationSlot<T>::Value());
+
+			if (index >= slots.size())
+			{
+				slots.resize(index + 1, nullptr);
+				deleters.resize(index + 1, nullptr);
+			}
+
+			if (slots[index] == nullptr)
+			{
+				slots[index] = new T;
+				deleters[index] = &Delete<T>;
+			}
+
+			return *static_cast<T*>(slots[index]);
+		}
+
+	private:
+		template <typename T>
+		static void Delete(void* ptr) { delete static_cast<T*>(ptr); }
+
+		std::vector<void*>			slots;
+		std::vector<void(*)(void*)>	deleters;
+	};
+
+	namespace Internal
+	{
+		typedef void* (*UpcastFunction)(void*);
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		/// <summary>
+		/// 	Every pair of a bound class and one of its bound ancestors (see CO_BaseClass) with the
+		/// 	pointer cast between them, keyed by their CO_Identifier pointers. Process wide, since
+		/// 	wrappers only record the identifier of the class they were made as.
+		/// 	
+		/// 	Written once per pair when the derived ClassGear is initialized, read on every call of an
+		/// 	inherited member on a derived wrapper, so a write publishes a new table and readers only
+		/// 	load a pointer. Replaced tables are kept, a reader may still be looking at one.
+		/// </summary>
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		class ClassHierarchy
+		{
+		public:
+			static void Register(const std::string* derived, const std::string* base, UpcastFunction cast)
+			{
+				ClassHierarchy& hierarchy = Shared();
+				std::lock_guard<std::mutex> guard(hierarchy.lock);
+
+				const Table* current = hierarchy.current.load(std::memory_order_acquire);
+
+				if (current != nullptr && current->count(Key(derived, base)) != 0)
+					return;
+
+				Table* next = current != nullptr ? new Table(*current) : new Table;
+				(*next)[Key(derived, base)] = cast;
+
+				hierarchy.tables.push_back(std::unique_ptr<Table>(next));
+				hierarchy.current.store(next, std::memory_order_release);
+			}
+
+			/** The cast from derived to base, nullptr when base isn't a registered ancestor of derived. */
+			static UpcastFunction Find(const std::string* derived, const std::string* base)
+			{
+				const Table* current = Shared().current.load(std::memory_order_acquire);
+
+				if (current == nullptr)
+					return nullptr;
+
+				Table::const_iterator it = current->find(Key(derived, base));
+
+				return it != current->end() ? it->second : nullptr;
+			}
+
+		private:
+			typedef std::pair<const std::string*, const std::string*> Key;
+
+			struct KeyHash
+			{
+				size_t operator()(const Key& key) const
+				{
+					return std::hash<const void*>()(key.first) * 31 + std::hash<const void*>()(key.second);
+				}
+			};
+
+			typedef std::unordered_map<Key, UpcastFunction, KeyHash> Table;
+
+			std::mutex							lock;
+			std::atomic<const Table*>			current;
+			std::vector<std::unique_ptr<Table> >	tables;
+
+			ClassHierarchy() : current(nullptr) {}
+
+			static ClassHierarchy& Shared()
+			{
+				static ClassHierarchy* hierarchy = new ClassHierarchy;
+
+				return *hierarchy;
+			}
+		};
+	}
+
 	////////////////////////////////////////////////////////////////////////////////////////////////////
 	/// <summary>
-	/// 	An object isolation context, in the future all ClassGear related things will require binding
-	/// 	themselves to this to allow using multiple isolations and things of that likeness.
+	/// 	An object isolation context, the templates a ClassGear builds for one particular isolate.
 	/// 	
-	/// 	At least that's the theory, I've yet to look into this stuff yet.
+	/// 	V8 templates can't be shared between isolates, so every ClassGear keeps one of these per
+	/// 	isolate it has been initialized in.
 	/// </summary>
 	///
 	/// <typeparam name="T">	Generic type parameter. </typeparam>
@@ -64,19 +299,25 @@ namespace V8Transmission
 	{
 		typedef ForType Type;
 
-		v8::Isolate* isolate;
 		v8::Persistent<v8::FunctionTemplate>	ConstructorTemplate;
 		v8::Persistent<v8::ObjectTemplate>		PrototypeTemplate;
-	};
-
-	template <typename T>
-	v8::Isolate* V8Transmission::ObjectIsolationContext<T>::isolate;
+		v8::Persistent<v8::ObjectTemplate>		InstanceTemplate;
 
-	template <typename T>
-	Persistent<FunctionTemplate> V8Transmission::ObjectIsolationContext<T>::ConstructorTemplate;
+		/** Builds the templates on first use when the type was registered lazily, see ClassRegistry. */
+		void (*Materialize)(v8::Isolate*);
 
-	template <typename T>
-	Persistent<ObjectTemplate> V8Transmission::ObjectIsolationContext<T>::PrototypeTemplate;
+		ObjectIsolationContext() : Materialize(nullptr) {}
 
+		static ObjectIsolationContext& Get(v8::Isolate* iso)
+		{
+			return IsolateData::Get(iso).Slot<ObjectIsolationContext>();
+		}
 
+		~ObjectIsolationContext()
+		{
+			ConstructorTemplate.Reset();
+			PrototypeTemplate.Reset();
+			InstanceTemplate.Reset();
+		}
+	};
 }
\ No newline at end of file
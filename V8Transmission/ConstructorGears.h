@@ -0,0 +1,212 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+///	The MIT License (MIT)
+///
+///	Copyright (c) 2014 Gregory Hlavac
+///
+///	Permission is hereby granted, free of charge, to any person obtaining a copy
+///	of this software and associated documentation files (the "Software"), to deal
+///	in the Software without restriction, including without limitation the rights
+///	to use, copy, modify, merge, publish, distribute, sub-license, and/or sell
+///	copies of the Software, and to permit persons to whom the Software is
+///	furnished to do so, subject to the following conditions:
+///
+///	The above copyright notice and this permission notice shall be included in
+///	all copies or substantial portions of the Software.
+///
+///	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+///	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+///	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+///	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+///	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+///	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+///	THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <v8.h>
+
+#include <new>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <type_traits>
+
+#include "Common.h"
+#include "ClassOptions.h"
+
+namespace V8Transmission
+{
+	namespace Internal
+	{
+		/** One heap allocation per object, what new T would do. */
+		template <typename T>
+		struct HeapStorage
+		{
+			static void* Allocate() { return ::operator new(sizeof(T)); }
+			static void Deallocate(void* storage) { ::operator delete(storage); }
+		};
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		/// <summary>
+		/// 	Fixed size slots for one type, carved out of blocks that are kept for the life of the
+		/// 	process. Free slots are chained through their own storage, so taking and returning one is
+		/// 	a pointer swap under an uncontended lock instead of a trip through the heap.
+		/// </summary>
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		template <typename T>
+		class InlineStorage
+		{
+		public:
+			static void* Allocate()
+			{
+				InlineStorage& arena = Shared();
+				std::lock_guard<std::mutex> guard(arena.lock);
+
+				if (arena.free == nullptr)
+					arena.Grow();
+
+				Slot* slot = arena.free;
+				arena.free = slot->next;
+
+				return &slot->storage;
+			}
+
+			static void Deallocate(void* storage)
+			{
+				InlineStorage& arena = Shared();
+				std::lock_guard<std::mutex> guard(arena.lock);
+
+				Slot* slot = static_cast<Slot*>(storage);
+				slot->next = arena.free;
+				arena.free = slot;
+			}
+
+		private:
+			static_assert(std::is_trivially_destructible<T>::value, "CO_InlineStorage is only for trivially destructible types");
+			static_assert(sizeof(T) <= 256, "CO_InlineStorage is only for small types");
+
+			union Slot
+			{
+				Slot*																	next;
+				typename std::aligned_storage<sizeof(T), std::alignment_of<T>::value>::type	storage;
+			};
+
+			enum { BlockSlots = 256 };
+
+			std::mutex							lock;
+			Slot*								free;
+			std::vector<std::unique_ptr<Slot[]> >	blocks;
+
+			InlineStorage() : free(nullptr) {}
+
+			static InlineStorage& Shared()
+			{
+				static InlineStorage* arena = new InlineStorage;
+
+				return *arena;
+			}
+
+			void Grow()
+			{
+				Slot* block = new Slot[BlockSlots];
+				blocks.push_back(std::unique_ptr<Slot[]>(block));
+
+				for (int i = BlockSlots - 1; i >= 0; i--)
+				{
+					block[i].next = free;
+					free = &block[i];
+				}
+			}
+		};
+
+		template <typename T>
+		struct ObjectStorage : std::conditional<CO_InlineStorage<T>::Value, InlineStorage<T>, HeapStorage<T> >::type {};
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	/// <summary>
+	/// 	A constructor gear, calls T(Args...) with the JS constructor's arguments converted through
+	/// 	ShiftNative, constructing in place into the storage the factory's Allocate hands out. Missing
+	/// 	arguments convert from undefined and extra ones are ignored, as with any JS function.
+	/// 	
+	/// 	Pick it (or a ConstructorOverloads of several) through CO_Constructors<T>.
+	/// </summary>
+	///
+	/// <typeparam name="T">   	The constructed type. </typeparam>
+	/// <typeparam name="Args">	The constructor's parameter types. </typeparam>
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	template <typename T, typename... Args>
+	struct ConstructorGear
+	{
+		typedef T Type;
+
+		enum { Arity = sizeof...(Args) };
+
+		template <typename Factory>
+		static T* Construct(const v8::FunctionCallbackInfo<v8::Value>& args)
+		{
+			return Expand<Factory>(args, typename Internal::BuildIndexList<sizeof...(Args)>::Type());
+		}
+
+	private:
+		template <typename Factory, int... Indices>
+		static T* Expand(const v8::FunctionCallbackInfo<v8::Value>& args, Internal::IndexList<Indices...>)
+		{
+			v8::Isolate* iso = args.GetIsolate();
+			void* storage = Factory::Allocate();
+
+			return new (storage) T(ConvertFromJS<typename std::decay<Args>::type>(iso, args[Indices])...);
+		}
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	/// <summary>
+	/// 	Several ConstructorGears for one type, picked by argument count. The first one taking exactly
+	/// 	as many arguments as were passed wins, failing that the first one taking fewer, and when none
+	/// 	fits the constructor throws a TypeError.
+	/// </summary>
+	///
+	/// <typeparam name="First">	The first ConstructorGear. </typeparam>
+	/// <typeparam name="Rest"> 	The other ConstructorGears, in order of preference. </typeparam>
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	template <typename First, typename... Rest>
+	struct ConstructorOverloads
+	{
+		typedef typename First::Type Type;
+
+		template <typename Factory>
+		static Type* Construct(const v8::FunctionCallbackInfo<v8::Value>& args)
+		{
+			Type* obj = nullptr;
+
+			if (Pick<Factory, First, Rest...>(args, true, obj) || Pick<Factory, First, Rest...>(args, false, obj))
+				return obj;
+
+			v8::Isolate* iso = args.GetIsolate();
+			std::string message = "No constructor of " + *CO_Identifier<Type>::Value() + " takes " + std::to_string(args.Length()) + " arguments";
+			iso->ThrowException(v8::Exception::TypeError(v8::String::NewFromUtf8(iso, message.c_str())));
+
+			return nullptr;
+		}
+
+	private:
+		template <typename Factory>
+		static bool Pick(const v8::FunctionCallbackInfo<v8::Value>& args, bool exact, Type*& obj)
+		{
+			return false;
+		}
+
+		template <typename Factory, typename Gear, typename... More>
+		static bool Pick(const v8::FunctionCallbackInfo<v8::Value>& args, bool exact, Type*& obj)
+		{
+			if (exact ? args.Length() == Gear::Arity : args.Length() > Gear::Arity)
+			{
+				obj = Gear::template Construct<Factory>(args);
+				return true;
+			}
+
+			return Pick<Factory, More...>(args, exact, obj);
+		}
+	};
+}
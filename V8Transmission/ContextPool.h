@@ -0,0 +1,364 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+///	The MIT License (MIT)
+///
+///	Copyright (c) 2014 Gregory Hlavac
+///
+///	Permission is hereby granted, free of charge, to any person obtaining a copy
+///	of this software and associated documentation files (the "Software"), to deal
+///	in the Software without restriction, including without limitation the rights
+///	to use, copy, modify, merge, publish, distribute, sub-license, and/or sell
+///	copies of the Software, and to permit persons to whom the Software is
+///	furnished to do so, subject to the following conditions:
+///
+///	The above copyright notice and this permission notice shall be included in
+///	all copies or substantial portions of the Software.
+///
+///	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+///	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+///	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+///	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+///	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+///	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+///	THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <v8.h>
+
+#include <deque>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <functional>
+
+#include "Common.h"
+
+namespace V8Transmission
+{
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	/// <summary>
+	/// 	A pool of ready to use contexts for one isolate, so handing a request its own context
+	/// 	doesn't cost building the global template, its bindings and running setup scripts each time.
+	/// 	
+	/// 	The factory builds a context (with whatever ClassGear bindings it installs), then every
+	/// 	warm-up script is run in it and the global's own properties are recorded. When a lease is
+	/// 	returned its global is reset to that record, properties the request added are deleted and
+	/// 	overwritten ones put back, and the context goes back in the pool. That is cheap but only as
+	/// 	deep as the global itself, so a context is discarded instead once it has served MaxUses
+	/// 	requests, if the lease asks for it, or if a property the request added can't be deleted
+	/// 	(a top level var or function declaration). Discarded contexts are only dropped, and replacements
+	/// 	built, from Maintain so neither happens on the request path.
+	/// 	
+	/// 	The pool is not an isolation boundary between requests. Only the global's own properties are
+	/// 	reset, anything a request does to the builtins (Array.prototype.x = ..., Object.prototype
+	/// 	pollution, replacing a builtin function) or to objects reachable from the global carries over
+	/// 	to the next request given that context. Requests that don't trust each other need MaxUses of
+	/// 	1, or a lease Discard()ed after any run that might have touched them.
+	/// 	
+	/// 	Everything here has to happen on the isolate's thread.
+	/// </summary>
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	class ContextPool
+	{
+		struct Entry;
+
+	public:
+		typedef std::function<v8::Handle<v8::Context>(v8::Isolate*)> Factory;
+
+		struct Stats
+		{
+			uint64_t	hits;
+			uint64_t	misses;
+			uint64_t	recycled;
+			uint64_t	discarded;
+
+			Stats() : hits(0), misses(0), recycled(0), discarded(0) {}
+		};
+
+		/** A context handed out by Acquire, returned to the pool when it goes out of scope. */
+		class Lease
+		{
+		public:
+			Lease() : pool(nullptr), entry(nullptr), discard(false) {}
+			Lease(Lease&& other) : pool(other.pool), entry(other.entry), discard(other.discard) { other.entry = nullptr; }
+			~Lease() { Release(); }
+
+			Lease& operator=(Lease&& other)
+			{
+				if (this != &other)
+				{
+					Release();
+
+					pool = other.pool;
+					entry = other.entry;
+					discard = other.discard;
+					other.entry = nullptr;
+				}
+
+				return *this;
+			}
+
+			/** False if Acquire couldn't build a context, check it before using Context(). */
+			bool Valid() const { return entry != nullptr; }
+
+			/** The leased context, an empty handle for an invalid lease. */
+			v8::Local<v8::Context> Context() const
+			{
+				if (entry == nullptr)
+					return v8::Local<v8::Context>();
+
+				return v8::Local<v8::Context>::New(pool->isolate, entry->context);
+			}
+
+			/** Don't put the context back, for requests that may have left anything behind the global. */
+			void Discard() { discard = true; }
+
+			/** Hands the context back now rather than when the lease is destroyed. */
+			void Release()
+			{
+				if (entry != nullptr)
+					pool->Return(entry, discard);
+
+				entry = nullptr;
+			}
+
+		private:
+			friend class ContextPool;
+
+			Lease(const Lease&);
+			Lease& operator=(const Lease&);
+
+			ContextPool*	pool;
+			Entry*			entry;
+			bool			discard;
+		};
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		/// <summary>
+		/// 	Constructor.
+		/// </summary>
+		///
+		/// <param name="iso">	   	[in,out] If non-null, the ISO. </param>
+		/// <param name="factory"> 	Builds a new context with all its bindings installed. </param>
+		/// <param name="capacity">	How many idle contexts to keep ready. </param>
+		/// <param name="maxUses"> 	Requests a context serves before it is discarded, 0 for no limit. </param>
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		ContextPool(v8::Isolate* iso, Factory factory, size_t capacity, unsigned maxUses = 0)
+			: isolate(iso), factory(std::move(factory)), capacity(capacity), maxUses(maxUses) {}
+
+		~ContextPool()
+		{
+			// Not Maintain, that would build contexts up to capacity only to drop them.
+			for (size_t i = 0; i < retired.size(); i++)
+				Drop(retired[i]);
+
+			for (size_t i = 0; i < idle.size(); i++)
+				Drop(idle[i]);
+		}
+
+		/** Script run in every new context before it goes into the pool, e.g. to load shared helpers. */
+		void AddWarmupScript(const std::string& source, const std::string& name = "(warmup)")
+		{
+			warmups.push_back(std::make_pair(source, name));
+		}
+
+		/** Builds contexts until the pool is full, call it at startup so the first requests hit. */
+		void Fill()
+		{
+			while (idle.size() < capacity)
+			{
+				Entry* entry = Create();
+
+				if (entry == nullptr)
+					break;
+
+				idle.push_back(entry);
+			}
+		}
+
+		/** A pooled context if there is one (a hit), otherwise a new one built right away (a miss). The lease is invalid if that build failed. */
+		Lease Acquire()
+		{
+			Lease lease;
+			lease.pool = this;
+
+			if (!idle.empty())
+			{
+				stats.hits++;
+				lease.entry = idle.front();
+				idle.pop_front();
+			}
+			else
+			{
+				stats.misses++;
+				lease.entry = Create();
+			}
+
+			if (lease.entry != nullptr)
+				lease.entry->uses++;
+
+			return lease;
+		}
+
+		/** Drops discarded contexts and refills the pool, call it when the isolate is otherwise idle. */
+		void Maintain()
+		{
+			for (size_t i = 0; i < retired.size(); i++)
+				Drop(retired[i]);
+
+			retired.clear();
+			Fill();
+		}
+
+		const Stats& Statistics() const	{ return stats; }
+		size_t Idle() const				{ return idle.size(); }
+
+	private:
+		struct Entry
+		{
+			v8::Persistent<v8::Context>	context;
+			v8::Persistent<v8::Array>	baselineNames;
+			v8::Persistent<v8::Array>	baselineValues;
+			/** Stands in baselineValues for a property that was an accessor, which Reset leaves alone. */
+			v8::Persistent<v8::Object>	accessorMark;
+			unsigned					uses;
+
+			Entry() : uses(0) {}
+		};
+
+		Entry* Create()
+		{
+			v8::HandleScope scope(isolate);
+
+			v8::Local<v8::Context> context = factory(isolate);
+
+			if (context.IsEmpty())
+				return nullptr;
+
+			v8::Context::Scope contextScope(context);
+
+			for (size_t i = 0; i < warmups.size(); i++)
+			{
+				v8::TryCatch tryCatch;
+				v8::Local<v8::Script> script = v8::Script::Compile(v8::String::NewFromUtf8(isolate, warmups[i].first.c_str()), v8::String::NewFromUtf8(isolate, warmups[i].second.c_str()));
+
+				if (script.IsEmpty() || script->Run().IsEmpty())
+					return nullptr;
+			}
+
+			// What the global looks like ready to serve, Reset puts it back to this. Accessors are only
+			// recorded by name, reading them would run them, which for ClassRegistry's lazy classes
+			// builds every class in every pooled context.
+			v8::Local<v8::Object> global = context->Global();
+			v8::Local<v8::Array> names = global->GetOwnPropertyNames();
+			v8::Local<v8::Array> values = v8::Array::New(isolate, names->Length());
+			v8::Local<v8::Object> accessor = v8::Object::New(isolate);
+
+			for (uint32_t i = 0; i < names->Length(); i++)
+			{
+				v8::Local<v8::String> name = names->Get(i)->ToString();
+
+				values->Set(i, global->HasRealNamedCallbackProperty(name) ? v8::Local<v8::Value>(accessor) : global->GetRealNamedProperty(name));
+			}
+
+			Entry* entry = new Entry;
+			entry->context.Reset(isolate, context);
+			entry->baselineNames.Reset(isolate, names);
+			entry->baselineValues.Reset(isolate, values);
+			entry->accessorMark.Reset(isolate, accessor);
+
+			return entry;
+		}
+
+		void Return(Entry* entry, bool discard)
+		{
+			if (discard || (maxUses != 0 && entry->uses >= maxUses) || idle.size() >= capacity || !Reset(entry))
+			{
+				stats.discarded++;
+				retired.push_back(entry);
+				return;
+			}
+
+			stats.recycled++;
+			idle.push_back(entry);
+		}
+
+		/** Puts the global's own properties back the way they were after warm-up. */
+		bool Reset(Entry* entry)
+		{
+			v8::HandleScope scope(isolate);
+
+			v8::Local<v8::Context> context = v8::Local<v8::Context>::New(isolate, entry->context);
+			v8::Context::Scope contextScope(context);
+			v8::TryCatch tryCatch;
+
+			v8::Local<v8::Object> global = context->Global();
+			v8::Local<v8::Array> names = v8::Local<v8::Array>::New(isolate, entry->baselineNames);
+			v8::Local<v8::Array> values = v8::Local<v8::Array>::New(isolate, entry->baselineValues);
+			v8::Local<v8::Object> accessor = v8::Local<v8::Object>::New(isolate, entry->accessorMark);
+			v8::Local<v8::Object> baseline = v8::Object::New(isolate);
+
+			for (uint32_t i = 0; i < names->Length(); i++)
+			{
+				v8::Local<v8::String> name = names->Get(i)->ToString();
+				v8::Local<v8::Value> value = values->Get(i);
+
+				baseline->Set(name, v8::True(isolate));
+
+				// Baseline accessors are left as they are, and the current value is never read through
+				// one, see Create. ForceSet replaces an accessor the request put in place of a value.
+				if (value->StrictEquals(accessor))
+					continue;
+
+				if (!global->HasRealNamedCallbackProperty(name))
+				{
+					v8::Local<v8::Value> current = global->GetRealNamedProperty(name);
+
+					if (!current.IsEmpty() && current->StrictEquals(value))
+						continue;
+				}
+
+				global->ForceSet(name, value);
+			}
+
+			v8::Local<v8::Array> current = global->GetOwnPropertyNames();
+
+			for (uint32_t i = 0; i < current->Length(); i++)
+			{
+				v8::Local<v8::Value> name = current->Get(i);
+
+				// Own properties only, "toString" and friends would otherwise be found on Object.prototype.
+				if (baseline->HasOwnProperty(name->ToString()))
+					continue;
+
+				// Top level var and function declarations can't be deleted, their state would carry
+				// over to the next request.
+				if (!global->Delete(name->ToString()))
+					return false;
+			}
+
+			// Anything throwing here (a getter, a frozen property) means the reset can't be trusted.
+			return !tryCatch.HasCaught();
+		}
+
+		void Drop(Entry* entry)
+		{
+			entry->context.Reset();
+			entry->baselineNames.Reset();
+			entry->baselineValues.Reset();
+			entry->accessorMark.Reset();
+
+			delete entry;
+		}
+
+		v8::Isolate*								isolate;
+		Factory										factory;
+		size_t										capacity;
+		unsigned									maxUses;
+		std::vector<std::pair<std::string, std::string> >	warmups;
+
+		std::deque<Entry*>							idle;
+		std::vector<Entry*>							retired;
+		Stats										stats;
+	};
+}
@@ -0,0 +1,424 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+///	The MIT License (MIT)
+///
+///	Copyright (c) 2014 Gregory Hlavac
+///
+///	Permission is hereby granted, free of charge, to any person obtaining a copy
+///	of this software and associated documentation files (the "Software"), to deal
+///	in the Software without restriction, including without limitation the rights
+///	to use, copy, modify, merge, publish, distribute, sub-license, and/or sell
+///	copies of the Software, and to permit persons to whom the Software is
+///	furnished to do so, subject to the following conditions:
+///
+///	The above copyright notice and this permission notice shall be included in
+///	all copies or substantial portions of the Software.
+///
+///	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+///	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+///	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+///	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+///	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+///	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+///	THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <v8.h>
+
+#include <string>
+#include <utility>
+#include <exception>
+#include <functional>
+#include <type_traits>
+
+#include "Common.h"
+#include "AsyncGears.h"
+#include "FunctionGears.h"
+
+// Coroutine gears need a C++20 compiler, on anything older this header compiles to nothing so
+// the rest of the library can still include it unconditionally.
+#if !defined(V8T_ENABLE_COROUTINES)
+#	if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+#		define V8T_ENABLE_COROUTINES 1
+#	else
+#		define V8T_ENABLE_COROUTINES 0
+#	endif
+#endif
+
+#if V8T_ENABLE_COROUTINES
+
+#include <coroutine>
+
+namespace V8Transmission
+{
+	template <typename T>
+	class JSTask;
+
+	namespace Internal
+	{
+		namespace Coroutine_Resume_Settle
+		{
+			////////////////////////////////////////////////////////////////////////////////////////////////////
+			/// <summary>
+			/// 	The part of a JSTask's promise_type that doesn't depend on the result type, it owns the
+			/// 	Promise::Resolver handed to javascript and knows how to get back onto the isolate thread.
+			/// </summary>
+			////////////////////////////////////////////////////////////////////////////////////////////////////
+			struct PromiseBase
+			{
+				Isolate*							iso = nullptr;
+				Persistent<v8::Promise::Resolver>	resolver;
+				Persistent<v8::Context>				context;
+				Persistent<Object>					receiver;
+				std::exception_ptr					error;
+
+				std::suspend_always initial_suspend() noexcept { return {}; }
+
+				void unhandled_exception() noexcept { error = std::current_exception(); }
+
+				/** Resumes the coroutine inside the context it was started from, only ever called on the isolate thread. */
+				void Resume(std::coroutine_handle<> handle)
+				{
+					v8::HandleScope scope(iso);
+					v8::Context::Scope context_scope(Local<v8::Context>::New(iso, context));
+
+					handle.resume();
+				}
+
+				void Reject(Local<v8::Promise::Resolver> lresolver)
+				{
+					std::string message = "Unknown native exception.";
+
+					try
+					{
+						std::rethrow_exception(error);
+					}
+					catch (const std::exception& e)
+					{
+						message = e.what();
+					}
+					catch (...)
+					{
+					}
+
+					lresolver->Reject(v8::Exception::Error(v8::String::NewFromUtf8(iso, message.c_str())));
+				}
+
+				void Release()
+				{
+					resolver.Reset();
+					context.Reset();
+					receiver.Reset();
+				}
+			};
+
+			/** Where co_return puts the result until the promise is settled. */
+			template <typename T>
+			struct ResultHolder
+			{
+				T value{};
+
+				template <typename U>
+				void return_value(U&& result) { value = std::forward<U>(result); }
+
+				ValueHandle ToJS(Isolate* iso) { return ConvertToJS(iso, std::move(value)); }
+			};
+
+			template <>
+			struct ResultHolder<void>
+			{
+				void return_void() {}
+
+				ValueHandle ToJS(Isolate* iso) { return v8::Undefined(iso); }
+			};
+
+			/** Settles the promise once the coroutine body has finished, then lets the frame go. */
+			template <typename Promise>
+			struct FinalAwaiter
+			{
+				bool await_ready() const noexcept { return false; }
+
+				void await_suspend(std::coroutine_handle<Promise> handle) noexcept
+				{
+					handle.promise().Settle();
+					handle.destroy();
+				}
+
+				void await_resume() const noexcept {}
+			};
+
+			////////////////////////////////////////////////////////////////////////////////////////////////////
+			/// <summary>
+			/// 	Shared state between a suspended coroutine and the native operation it is waiting on, the
+			/// 	native side calls Complete/Fail from any thread, the coroutine is resumed from the isolate's
+			/// 	CompletionQueue.
+			/// </summary>
+			////////////////////////////////////////////////////////////////////////////////////////////////////
+			template <typename T>
+			struct Resumption
+			{
+				T					value{};
+				std::exception_ptr	error;
+
+				T Take()
+				{
+					if (error)
+						std::rethrow_exception(error);
+
+					return std::move(value);
+				}
+
+				template <typename Call>
+				void Produce(Call& call) { value = call(); }
+			};
+
+			template <>
+			struct Resumption<void>
+			{
+				std::exception_ptr	error;
+
+				void Take()
+				{
+					if (error)
+						std::rethrow_exception(error);
+				}
+
+				template <typename Call>
+				void Produce(Call& call) { call(); }
+			};
+
+			template <typename T>
+			struct AwaiterBase
+			{
+				Resumption<T>	state;
+
+				bool await_ready() const noexcept { return false; }
+
+				T await_resume() { return state.Take(); }
+
+			protected:
+				/** Marks an operation as in flight on the current isolate and returns how to resume the coroutine. */
+				template <typename Promise>
+				std::function<void()> Arm(std::coroutine_handle<Promise> handle)
+				{
+					std::shared_ptr<CompletionQueue> queue = CompletionQueue::Share(handle.promise().iso);
+					queue->BeginOperation();
+
+					return [queue, handle]()
+					{
+						queue->Post([handle](Isolate*) { handle.promise().Resume(handle); });
+					};
+				}
+			};
+		}
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	/// <summary>
+	/// 	The return type for native coroutines bound through StaticFunctionGear or MemberFunctionGear.
+	/// 	
+	/// 	The gear hands javascript a Promise and starts the coroutine, every co_await on one of the
+	/// 	awaitables below suspends it without blocking the isolate and it is resumed on the isolate
+	/// 	thread when the host loop drains the CompletionQueue. co_return resolves the promise, an
+	/// 	escaping exception rejects it.
+	/// 	
+	/// 	Example
+	/// 	
+	/// 	JSTask<std::string> transform(std::string path)
+	/// 	{
+	/// 		std::string text = co_await OffloadToPool([path]() { return read_file(path); });
+	/// 		std::string result = co_await OffloadToPool([text]() { return compress(text); });
+	/// 		co_return result;
+	/// 	}
+	/// 	...
+	/// 	global->Set(String::NewFromUtf8(isolate, "transform"), FunctionTemplate::New(isolate, StaticFunctionGear<JSTask<std::string>, std::string>::Invoke<transform>));
+	/// 	
+	/// 	Parameters must be taken by value, the converted arguments are temporaries that are gone by
+	/// 	the time the coroutine first suspends.
+	/// </summary>
+	///
+	/// <typeparam name="T">	The type the promise resolves to. </typeparam>
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	template <typename T>
+	class JSTask
+	{
+	public:
+		struct promise_type : Internal::Coroutine_Resume_Settle::PromiseBase, Internal::Coroutine_Resume_Settle::ResultHolder<T>
+		{
+			JSTask get_return_object() { return JSTask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+
+			Internal::Coroutine_Resume_Settle::FinalAwaiter<promise_type> final_suspend() noexcept { return {}; }
+
+			void Settle()
+			{
+				v8::HandleScope scope(iso);
+				v8::Context::Scope context_scope(Local<v8::Context>::New(iso, context));
+
+				Local<v8::Promise::Resolver> lresolver = Local<v8::Promise::Resolver>::New(iso, resolver);
+
+				if (error)
+					Reject(lresolver);
+				else
+					lresolver->Resolve(this->ToJS(iso));
+
+				Release();
+			}
+		};
+
+		JSTask(JSTask&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+
+		JSTask(const JSTask&) = delete;
+		JSTask& operator=(const JSTask&) = delete;
+
+		~JSTask()
+		{
+			if (handle)
+				handle.destroy();
+		}
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		/// <summary>
+		/// 	Attaches a fresh Promise::Resolver to the coroutine and runs it up to its first suspension,
+		/// 	from here on the coroutine frame owns itself and is destroyed once it has settled.
+		/// </summary>
+		///
+		/// <param name="iso">	  	The isolate the coroutine belongs to. </param>
+		/// <param name="holder">	The JS object to keep alive until it settles, may be empty. </param>
+		///
+		/// <returns>
+		/// 	The promise handed to javascript.
+		/// </returns>
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		Local<v8::Promise> Start(Isolate* iso, Handle<Object> holder)
+		{
+			promise_type& promise = handle.promise();
+
+			Local<v8::Promise::Resolver> lresolver = v8::Promise::Resolver::New(iso);
+
+			promise.iso = iso;
+			promise.resolver.Reset(iso, lresolver);
+			promise.context.Reset(iso, iso->GetCurrentContext());
+
+			if (!holder.IsEmpty())
+				promise.receiver.Reset(iso, holder);
+
+			std::exchange(handle, nullptr).resume();
+
+			return lresolver->GetPromise();
+		}
+
+	private:
+		explicit JSTask(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+
+		std::coroutine_handle<promise_type> handle;
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	/// <summary>
+	/// 	Awaitable that runs a blocking callable on the WorkerPool and resumes the coroutine on the
+	/// 	isolate thread with its result, an exception thrown by the callable is rethrown at the
+	/// 	co_await.
+	/// </summary>
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	template <typename Callable>
+	struct PoolAwaiter : Internal::Coroutine_Resume_Settle::AwaiterBase<decltype(std::declval<Callable&>()())>
+	{
+		Callable callable;
+
+		explicit PoolAwaiter(Callable callable) : callable(std::move(callable)) {}
+
+		template <typename Promise>
+		void await_suspend(std::coroutine_handle<Promise> handle)
+		{
+			std::function<void()> resume = this->Arm(handle);
+
+			WorkerPool::Shared().Post([this, resume]()
+			{
+				try
+				{
+					this->state.Produce(callable);
+				}
+				catch (...)
+				{
+					this->state.error = std::current_exception();
+				}
+
+				resume();
+			});
+		}
+	};
+
+	template <typename Callable>
+	PoolAwaiter<Callable> OffloadToPool(Callable callable)
+	{
+		return PoolAwaiter<Callable>(std::move(callable));
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	/// <summary>
+	/// 	Awaitable over a callback style native async operation.
+	/// 	
+	/// 	The starter is handed a Completion, the native operation calls Complete(value) or
+	/// 	Fail(exception_ptr) on it exactly once from whatever thread it finishes on.
+	/// 	
+	/// 	Example
+	/// 	
+	/// 	size_t written = co_await NativeAsync<size_t>([&](NativeAsync<size_t>::Completion done)
+	/// 	{
+	/// 		file.WriteAsync(buffer, [done](size_t n) mutable { done.Complete(n); });
+	/// 	});
+	/// </summary>
+	///
+	/// <typeparam name="T">	The type the co_await evaluates to. </typeparam>
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	template <typename T>
+	struct NativeAsync : Internal::Coroutine_Resume_Settle::AwaiterBase<T>
+	{
+		struct Completion
+		{
+			NativeAsync*			awaiter;
+			std::function<void()>	resume;
+
+			template <typename... U>
+			void Complete(U&&... result)
+			{
+				if constexpr (sizeof...(U) != 0)
+					awaiter->state.value = T(std::forward<U>(result)...);
+
+				resume();
+			}
+
+			void Fail(std::exception_ptr error)
+			{
+				awaiter->state.error = error;
+				resume();
+			}
+		};
+
+		std::function<void(Completion)> starter;
+
+		explicit NativeAsync(std::function<void(Completion)> starter) : starter(std::move(starter)) {}
+
+		template <typename Promise>
+		void await_suspend(std::coroutine_handle<Promise> handle)
+		{
+			Completion completion = { this, this->Arm(handle) };
+			starter(completion);
+		}
+	};
+
+	namespace Internal
+	{
+		/** Coroutine results turn into a Promise rather than a converted value. */
+		template <typename T>
+		struct ReturnShift<JSTask<T> >
+		{
+			void operator()(const FunctionCallbackInfo<Value>& args, JSTask<T> task) const
+			{
+				args.GetReturnValue().Set(task.Start(args.GetIsolate(), args.Holder()));
+			}
+		};
+	}
+}
+
+#endif
@@ -0,0 +1,351 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+///	The MIT License (MIT)
+///
+///	Copyright (c) 2014 Gregory Hlavac
+///
+///	Permission is hereby granted, free of charge, to any person obtaining a copy
+///	of this software and associated documentation files (the "Software"), to deal
+///	in the Software without restriction, including without limitation the rights
+///	to use, copy, modify, merge, publish, distribute, sub-license, and/or sell
+///	copies of the Software, and to permit persons to whom the Software is
+///	furnished to do so, subject to the following conditions:
+///
+///	The above copyright notice and this permission notice shall be included in
+///	all copies or substantial portions of the Software.
+///
+///	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+///	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+///	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+///	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+///	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+///	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+///	THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <v8.h>
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+#include <functional>
+#include <condition_variable>
+
+#include "Common.h"
+
+namespace V8Transmission
+{
+	/** Per-isolate deadline counters, updated from the watchdog thread. */
+	struct DeadlineStats
+	{
+		std::atomic<uint64_t>	executions;
+		std::atomic<uint64_t>	softStops;
+		std::atomic<uint64_t>	hardStops;
+
+		DeadlineStats() : executions(0), softStops(0), hardStops(0) {}
+
+		/** Only call this on the isolate's thread, the watchdog gets handed the pointer when it is armed. */
+		static DeadlineStats& ForIsolate(v8::Isolate* iso)
+		{
+			return IsolateData::Get(iso).Slot<DeadlineStats>();
+		}
+	};
+
+	namespace Internal
+	{
+		/** One armed deadline stage, shared between its ExecutionDeadline and the watchdog's wheel. */
+		struct DeadlineTimer
+		{
+			enum State { Armed, Firing, Fired, Disarmed };
+
+			v8::Isolate*				isolate;
+			bool						hard;
+			DeadlineStats*				stats;
+			std::function<void()>		onSoftStop;
+
+			std::atomic<int>			state;
+			std::atomic<bool>			expired;
+			std::atomic<bool>			finished;
+			size_t						rounds;
+
+			DeadlineTimer() : isolate(nullptr), hard(false), stats(nullptr), state(Armed), expired(false), finished(false), rounds(0) {}
+		};
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	/// <summary>
+	/// 	The one thread that watches every armed deadline, on a hashed timer wheel so arming and
+	/// 	disarming stay O(1) however many executions are in flight.
+	/// 	
+	/// 	Disarmed timers are only dropped lazily once the wheel reaches their slot. The thread
+	/// 	sleeps on a condition variable while nothing is armed.
+	/// </summary>
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	class Watchdog
+	{
+	public:
+		typedef std::chrono::steady_clock Clock;
+		typedef std::shared_ptr<Internal::DeadlineTimer> TimerPtr;
+
+		static const size_t WheelSlots = 512;
+
+		static Watchdog& Shared()
+		{
+			static Watchdog watchdog;
+
+			return watchdog;
+		}
+
+		/** Puts a timer on the wheel to go off once delay has passed, rounded up to whole ticks. */
+		void Arm(const TimerPtr& timer, std::chrono::microseconds delay)
+		{
+			size_t ticks = static_cast<size_t>((delay + tick - std::chrono::microseconds(1)) / tick);
+
+			if (ticks == 0)
+				ticks = 1;
+
+			std::lock_guard<std::mutex> lock(mutex);
+
+			timer->rounds = (ticks - 1) / WheelSlots;
+			wheel[(cursor + ticks) % WheelSlots].push_back(timer);
+
+			if (armed++ == 0)
+				wake.notify_one();
+		}
+
+		~Watchdog()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stopping = true;
+			}
+
+			wake.notify_one();
+			thread.join();
+		}
+
+	private:
+		Watchdog() : tick(std::chrono::milliseconds(1)), wheel(WheelSlots), cursor(0), armed(0), stopping(false)
+		{
+			thread = std::thread([this]() { Run(); });
+		}
+
+		void Run()
+		{
+			std::vector<TimerPtr> due;
+			std::unique_lock<std::mutex> lock(mutex);
+			Clock::time_point next = Clock::now();
+
+			while (!stopping)
+			{
+				if (armed == 0)
+				{
+					wake.wait(lock, [this]() { return stopping || armed != 0; });
+					next = Clock::now();
+					continue;
+				}
+
+				// Falls through without sleeping while behind, catching up a slot at a time.
+				next += tick;
+				wake.wait_until(lock, next, [this]() { return stopping; });
+
+				cursor = (cursor + 1) % WheelSlots;
+				std::vector<TimerPtr>& slot = wheel[cursor];
+
+				for (size_t i = 0; i < slot.size();)
+				{
+					Internal::DeadlineTimer& timer = *slot[i];
+
+					if (timer.state.load() == Internal::DeadlineTimer::Armed && timer.rounds != 0)
+					{
+						timer.rounds--;
+						i++;
+						continue;
+					}
+
+					if (timer.state.load() == Internal::DeadlineTimer::Armed)
+						due.push_back(slot[i]);
+
+					slot[i] = slot.back();
+					slot.pop_back();
+					armed--;
+				}
+
+				if (due.empty())
+					continue;
+
+				lock.unlock();
+
+				for (size_t i = 0; i < due.size(); i++)
+					Fire(due[i]);
+
+				due.clear();
+				lock.lock();
+			}
+		}
+
+		static void Fire(const TimerPtr& timer)
+		{
+			int expected = Internal::DeadlineTimer::Armed;
+
+			// Lost the race against the execution finishing, nothing to stop.
+			if (!timer->state.compare_exchange_strong(expected, Internal::DeadlineTimer::Firing))
+				return;
+
+			timer->expired = true;
+
+			if (timer->hard)
+			{
+				timer->stats->hardStops++;
+				timer->isolate->TerminateExecution();
+			}
+			else
+			{
+				timer->stats->softStops++;
+				timer->isolate->RequestInterrupt(SoftStop, new TimerPtr(timer));
+			}
+
+			timer->state = Internal::DeadlineTimer::Fired;
+		}
+
+		/** Runs on the isolate's thread at its next interrupt check. */
+		static void SoftStop(v8::Isolate* iso, void* data)
+		{
+			TimerPtr* timer = static_cast<TimerPtr*>(data);
+
+			if (!(*timer)->finished && (*timer)->onSoftStop)
+				(*timer)->onSoftStop();
+
+			delete timer;
+		}
+
+		Clock::duration						tick;
+		std::vector<std::vector<TimerPtr> >	wheel;
+		size_t								cursor;
+		size_t								armed;
+		bool								stopping;
+
+		std::mutex							mutex;
+		std::condition_variable				wake;
+		std::thread							thread;
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	/// <summary>
+	/// 	A time limit on whatever runs in the isolate while this is in scope, put one around the
+	/// 	Script::Run of each request.
+	/// 	
+	/// 	Once the soft limit passes the watchdog asks the isolate for an interrupt, which calls the
+	/// 	onSoftStop hook on the isolate's thread and makes SoftExpired (and Check, bound into scripts)
+	/// 	report true, so well behaved scripts can wrap up. Once the hard limit passes it calls
+	/// 	TerminateExecution. Either stage may be left out by passing zero.
+	/// 	
+	/// 	The destructor disarms both, and if the execution was terminated it calls
+	/// 	CancelTerminateExecution so the isolate can run the next request. Use it only around top
+	/// 	level executions, cancelling from inside nested javascript would let the outer frames carry
+	/// 	on.
+	/// </summary>
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	class ExecutionDeadline
+	{
+	public:
+		ExecutionDeadline(v8::Isolate* iso, std::chrono::microseconds hard, std::chrono::microseconds soft = std::chrono::microseconds(0), std::function<void()> onSoftStop = std::function<void()>())
+			: isolate(iso), previous(Current(iso))
+		{
+			DeadlineStats& stats = DeadlineStats::ForIsolate(iso);
+			stats.executions++;
+
+			if (soft.count() > 0)
+			{
+				softTimer = std::make_shared<Internal::DeadlineTimer>();
+				softTimer->isolate = iso;
+				softTimer->stats = &stats;
+				softTimer->onSoftStop = std::move(onSoftStop);
+
+				Watchdog::Shared().Arm(softTimer, soft);
+			}
+
+			if (hard.count() > 0)
+			{
+				hardTimer = std::make_shared<Internal::DeadlineTimer>();
+				hardTimer->isolate = iso;
+				hardTimer->hard = true;
+				hardTimer->stats = &stats;
+
+				Watchdog::Shared().Arm(hardTimer, hard);
+			}
+
+			Current(iso) = this;
+		}
+
+		~ExecutionDeadline()
+		{
+			Current(isolate) = previous;
+
+			if (softTimer)
+			{
+				softTimer->finished = true;
+				Disarm(*softTimer);
+			}
+
+			if (hardTimer && !Disarm(*hardTimer))
+				isolate->CancelTerminateExecution();
+		}
+
+		bool SoftExpired() const	{ return softTimer && softTimer->expired; }
+		bool Terminated() const		{ return hardTimer && hardTimer->expired; }
+
+		/** Whether the innermost deadline in scope on this isolate has passed its soft limit. */
+		static bool SoftExpired(v8::Isolate* iso)
+		{
+			ExecutionDeadline* current = Current(iso);
+
+			return current != nullptr && current->SoftExpired();
+		}
+
+		/** Callback for binding into scripts, returns true once they should wrap up. */
+		static void Check(const v8::FunctionCallbackInfo<v8::Value>& args)
+		{
+			args.GetReturnValue().Set(SoftExpired(args.GetIsolate()));
+		}
+
+	private:
+		ExecutionDeadline(const ExecutionDeadline&);
+		ExecutionDeadline& operator=(const ExecutionDeadline&);
+
+		struct Scope
+		{
+			ExecutionDeadline* current;
+
+			Scope() : current(nullptr) {}
+		};
+
+		static ExecutionDeadline*& Current(v8::Isolate* iso)
+		{
+			return IsolateData::Get(iso).Slot<Scope>().current;
+		}
+
+		/** True if the timer never went off, otherwise waits for the watchdog to finish firing it. */
+		static bool Disarm(Internal::DeadlineTimer& timer)
+		{
+			int expected = Internal::DeadlineTimer::Armed;
+
+			if (timer.state.compare_exchange_strong(expected, Internal::DeadlineTimer::Disarmed))
+				return true;
+
+			while (timer.state.load() == Internal::DeadlineTimer::Firing)
+				std::this_thread::yield();
+
+			return false;
+		}
+
+		v8::Isolate*				isolate;
+		ExecutionDeadline*			previous;
+		Watchdog::TimerPtr			softTimer;
+		Watchdog::TimerPtr			hardTimer;
+	};
+}
@@ -0,0 +1,357 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+///	The MIT License (MIT)
+///
+///	Copyright (c) 2014 Gregory Hlavac
+///
+///	Permission is hereby granted, free of charge, to any person obtaining a copy
+///	of this software and associated documentation files (the "Software"), to deal
+///	in the Software without restriction, including without limitation the rights
+///	to use, copy, modify, merge, publish, distribute, sub-license, and/or sell
+///	copies of the Software, and to permit persons to whom the Software is
+///	furnished to do so, subject to the following conditions:
+///
+///	The above copyright notice and this permission notice shall be included in
+///	all copies or substantial portions of the Software.
+///
+///	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+///	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+///	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+///	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+///	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+///	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+///	THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <v8.h>
+
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <stdio.h>
+#include <functional>
+#include <vector>
+#include <utility>
+#include <stdint.h>
+#include <type_traits>
+
+#include "Common.h"
+#include "AsyncGears.h"
+
+namespace V8Transmission
+{
+	namespace Internal
+	{
+		/** Hands a drained batch's storage to V8 as an external ArrayBuffer, freed once that is collected. */
+		template <typename Event>
+		struct EventBatchBuffer
+		{
+			std::vector<Event>*				events;
+			size_t							bytes;
+			v8::Persistent<v8::ArrayBuffer>	handle;
+
+			static v8::Local<v8::ArrayBuffer> Adopt(v8::Isolate* iso, std::vector<Event>* events)
+			{
+				EventBatchBuffer* cell = new EventBatchBuffer;
+				cell->events = events;
+				cell->bytes = events->size() * sizeof(Event);
+
+				v8::Local<v8::ArrayBuffer> buffer = v8::ArrayBuffer::New(iso, events->data(), cell->bytes);
+
+				cell->handle.Reset(iso, buffer);
+				cell->handle.SetWeak(cell, Free);
+				iso->AdjustAmountOfExternalAllocatedMemory(static_cast<int64_t>(cell->bytes));
+
+				return buffer;
+			}
+
+			static void Free(const v8::WeakCallbackData<v8::ArrayBuffer, EventBatchBuffer>& data)
+			{
+				EventBatchBuffer* cell = data.GetParameter();
+
+				data.GetIsolate()->AdjustAmountOfExternalAllocatedMemory(-static_cast<int64_t>(cell->bytes));
+				cell->handle.Reset();
+
+				delete cell->events;
+				delete cell;
+			}
+		};
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		/// <summary>
+		/// 	Turns a drained batch into the one value the handler gets, taking ownership of the vector.
+		/// 	
+		/// 	Events with a matching typed array arrive as one (over the batch's own storage, no copy),
+		/// 	other trivially copyable events as an ArrayBuffer of the packed structs for a DataView, and
+		/// 	everything else as an Array converted element by element with ShiftJS.
+		/// </summary>
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		template <typename Event, typename Enable = void>
+		struct EventBatch
+		{
+			static v8::Handle<v8::Value> ToJS(v8::Isolate* iso, std::vector<Event>* events)
+			{
+				v8::Handle<v8::Array> array = v8::Array::New(iso, static_cast<int>(events->size()));
+
+				for (size_t i = 0; i < events->size(); i++)
+					array->Set(static_cast<uint32_t>(i), ConvertToJS(iso, std::move((*events)[i])));
+
+				delete events;
+
+				return array;
+			}
+		};
+
+		template <typename Event>
+		struct EventBatch<Event, typename std::enable_if<HasTypedArray<Event>::value>::type>
+		{
+			static v8::Handle<v8::Value> ToJS(v8::Isolate* iso, std::vector<Event>* events)
+			{
+				size_t count = events->size();
+
+				return TypedArrayFor<Event>::Type::New(EventBatchBuffer<Event>::Adopt(iso, events), 0, count);
+			}
+		};
+
+		template <typename Event>
+		struct EventBatch<Event, typename std::enable_if<!HasTypedArray<Event>::value && !std::is_arithmetic<Event>::value && std::is_trivially_copyable<Event>::value>::type>
+		{
+			static v8::Handle<v8::Value> ToJS(v8::Isolate* iso, std::vector<Event>* events)
+			{
+				return EventBatchBuffer<Event>::Adopt(iso, events);
+			}
+		};
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	/// <summary>
+	/// 	Delivers events from native producers to a javascript handler in batches.
+	/// 	
+	/// 	Push is lock free and callable from any thread (a Vyukov style intrusive MPSC queue, one
+	/// 	exchange per event). The first push into an empty channel schedules one drain on the
+	/// 	isolate's CompletionQueue, and that drain takes everything queued by then, converts it into a
+	/// 	single value (see Internal::EventBatch) and calls the handler once as handler(batch, count).
+	/// 	So a burst of events costs one HandleScope, context entry and call instead of one each.
+	/// 	
+	/// 	Events have to be default constructible. The channel has to outlive any drain it scheduled,
+	/// 	so keep it for the life of the isolate, and Close it before the isolate is disposed if it
+	/// 	lives longer than that (a global channel is destroyed after V8::Dispose).
+	/// </summary>
+	///
+	/// <typeparam name="Event">	Type of the events. </typeparam>
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	template <typename Event>
+	class EventChannel
+	{
+	public:
+		/** Called with the TryCatch of a handler that threw, the default prints the exception to stderr. */
+		typedef std::function<void(v8::Isolate*, v8::TryCatch&)> ErrorReporter;
+
+		EventChannel() : head(&stub), tail(&stub), scheduled(false), isolate(nullptr)
+		{
+			stub.next = nullptr;
+		}
+
+		~EventChannel()
+		{
+			Event discarded;
+
+			while (Pop(discarded)) {}
+
+			handler.Reset();
+			context.Reset();
+		}
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		/// <summary>
+		/// 	Drops the handler and whatever is still queued, on the isolate's thread while it is alive.
+		/// 	Pushes after this are only kept until the channel is destroyed, nothing is scheduled for
+		/// 	them any more.
+		/// </summary>
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		void Close()
+		{
+			std::atomic_store(&queue, std::shared_ptr<CompletionQueue>());
+
+			Event discarded;
+
+			while (Pop(discarded)) {}
+
+			handler.Reset();
+			context.Reset();
+		}
+
+		/** Replaces how exceptions thrown by the handler are reported, on the isolate's thread. */
+		void SetErrorReporter(ErrorReporter reporter)
+		{
+			errorReporter = std::move(reporter);
+		}
+
+		/** Queues an event, from any thread. */
+		void Push(Event event)
+		{
+			Node* node = new Node(std::move(event));
+			Node* previous = head.exchange(node, std::memory_order_acq_rel);
+			previous->next.store(node, std::memory_order_release);
+
+			ScheduleDrain();
+		}
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		/// <summary>
+		/// 	Sets the function batches are delivered to, on the isolate's thread. Anything pushed before
+		/// 	a handler was set is delivered on the next drain.
+		/// </summary>
+		///
+		/// <param name="iso">	  	[in,out] If non-null, the ISO. </param>
+		/// <param name="function">	The handler, called as handler(batch, count). </param>
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		void SetHandler(v8::Isolate* iso, v8::Handle<v8::Function> function)
+		{
+			isolate = iso;
+			handler.Reset(iso, function);
+			context.Reset(iso, function->CreationContext());
+
+			std::atomic_store(&queue, CompletionQueue::Share(iso));
+
+			ScheduleDrain();
+		}
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		/// <summary>
+		/// 	Delivers up to max queued events to the handler in one call, on the isolate's thread. Runs
+		/// 	by itself through the CompletionQueue, but can be called directly to deliver sooner.
+		/// </summary>
+		///
+		/// <returns>
+		/// 	The number of events delivered.
+		/// </returns>
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		size_t Drain(size_t max = std::numeric_limits<size_t>::max())
+		{
+			// Cleared before taking anything, a push racing with this drain schedules the next one.
+			scheduled.store(false, std::memory_order_release);
+
+			if (handler.IsEmpty())
+				return 0;
+
+			std::vector<Event>* events = new std::vector<Event>;
+			Event event;
+
+			while (events->size() < max && Pop(event))
+				events->push_back(std::move(event));
+
+			size_t count = events->size();
+
+			if (count == 0)
+			{
+				delete events;
+				return 0;
+			}
+
+			v8::HandleScope scope(isolate);
+			v8::Local<v8::Context> ctx = v8::Local<v8::Context>::New(isolate, context);
+			v8::Context::Scope contextScope(ctx);
+
+			v8::Handle<v8::Value> argv[2] = { Internal::EventBatch<Event>::ToJS(isolate, events), v8::Number::New(isolate, static_cast<double>(count)) };
+
+			v8::TryCatch tryCatch;
+			v8::Local<v8::Function>::New(isolate, handler)->Call(ctx->Global(), 2, argv);
+
+			if (tryCatch.HasCaught())
+				ReportError(tryCatch);
+
+			// Stopped at max with more queued, nothing else would come back for the rest before the next push.
+			if (tail->next.load(std::memory_order_acquire) != nullptr)
+				ScheduleDrain();
+
+			return count;
+		}
+
+		/** Callback for binding into scripts as on(handler), needs the channel as its External data. */
+		static void Subscribe(const v8::FunctionCallbackInfo<v8::Value>& args)
+		{
+			EventChannel* channel = static_cast<EventChannel*>(v8::Handle<v8::External>::Cast(args.Data())->Value());
+
+			if (args.Length() < 1 || !args[0]->IsFunction())
+			{
+				args.GetIsolate()->ThrowException(v8::Exception::TypeError(v8::String::NewFromUtf8(args.GetIsolate(), "Expected a handler function")));
+				return;
+			}
+
+			channel->SetHandler(args.GetIsolate(), v8::Handle<v8::Function>::Cast(args[0]));
+		}
+
+		/** A function template for Subscribe bound to this channel. */
+		v8::Local<v8::FunctionTemplate> SubscribeTemplate(v8::Isolate* iso)
+		{
+			return v8::FunctionTemplate::New(iso, Subscribe, v8::External::New(iso, this));
+		}
+
+	private:
+		EventChannel(const EventChannel&);
+		EventChannel& operator=(const EventChannel&);
+
+		struct Node
+		{
+			std::atomic<Node*>	next;
+			Event				value;
+
+			Node() : next(nullptr) {}
+			explicit Node(Event&& value) : next(nullptr), value(std::move(value)) {}
+		};
+
+		/** Consumer side only, the isolate's thread. */
+		bool Pop(Event& out)
+		{
+			Node* current = tail;
+			Node* next = current->next.load(std::memory_order_acquire);
+
+			if (next == nullptr)
+				return false;
+
+			out = std::move(next->value);
+			tail = next;
+
+			if (current != &stub)
+				delete current;
+
+			return true;
+		}
+
+		void ReportError(v8::TryCatch& tryCatch)
+		{
+			if (errorReporter)
+			{
+				errorReporter(isolate, tryCatch);
+				return;
+			}
+
+			v8::String::Utf8Value message(tryCatch.Exception());
+
+			fprintf(stderr, "Uncaught exception in event handler: %s\n", *message != nullptr ? *message : "<string conversion failed>");
+		}
+
+		void ScheduleDrain()
+		{
+			std::shared_ptr<CompletionQueue> target = std::atomic_load(&queue);
+
+			if (target == nullptr || scheduled.exchange(true, std::memory_order_acq_rel))
+				return;
+
+			target->PostDetached([this](v8::Isolate*) { Drain(); });
+		}
+
+		Node							stub;
+		std::atomic<Node*>				head;
+		Node*							tail;
+
+		std::shared_ptr<CompletionQueue>	queue;			// only through atomic_load / atomic_store
+		std::atomic<bool>				scheduled;
+
+		v8::Isolate*					isolate;
+		v8::Persistent<v8::Function>	handler;
+		v8::Persistent<v8::Context>		context;
+		ErrorReporter					errorReporter;
+	};
+}
@@ -25,6 +25,11 @@
 
 #include <v8.h>
 
+#include <utility>
+#include <type_traits>
+
+#include "Tracing.h"
+
 using v8::Value;
 using v8::Local;
 using v8::Handle;
@@ -40,6 +45,25 @@ namespace V8Transmission
 {
 	namespace Internal
 	{
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		/// <summary>
+		/// 	Hands the result of a bound native function back to javascript as the call's return value.
+		/// 	
+		/// 	Specialize this for return types that need more than a plain ConvertToJS, such as the
+		/// 	JSTask<T> coroutine type which turns into a Promise.
+		/// </summary>
+		///
+		/// <typeparam name="ReturnType">	Type of the return type. </typeparam>
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		template <typename ReturnType>
+		struct ReturnShift
+		{
+			void operator()(const FunctionCallbackInfo<Value>& args, ReturnType value) const
+			{
+				args.GetReturnValue().Set(ConvertToJS(args.GetIsolate(), std::forward<ReturnType>(value)));
+			}
+		};
+
 		namespace Convert_Expand_Execute_Raw_Function_Pointer
 		{
 #pragma region Argument Expansion
@@ -59,7 +83,17 @@ namespace V8Transmission
 				template<class... Expanded>
 				static void expand(ReturnType(*NativeFunction)(Args...), const FunctionCallbackInfo<Value>& args, const Expanded&... expanded)
 				{
-					NativeFunction(ConvertFromJS<Args>(args.GetIsolate(), expanded)...);
+					ReturnShift<ReturnType>()(args, NativeFunction(ConvertFromJS<typename std::decay<Args>::type>(args.GetIsolate(), expanded)...));
+				}
+			};
+
+			template <int I, typename... Args>
+			struct Expander<I, I, void, Args...>
+			{
+				template<class... Expanded>
+				static void expand(void(*NativeFunction)(Args...), const FunctionCallbackInfo<Value>& args, const Expanded&... expanded)
+				{
+					NativeFunction(ConvertFromJS<typename std::decay<Args>::type>(args.GetIsolate(), expanded)...);
 				}
 			};
 #pragma endregion
@@ -89,7 +123,19 @@ namespace V8Transmission
 				template<class... Expanded>
 				static void expand(ThisClass* ptr, MemberFunctionPtr mfptr, const FunctionCallbackInfo<Value>& args, const Expanded&... expanded)
 				{
-					(ptr->*mfptr)(ConvertFromJS<Args>(args.GetIsolate(), expanded)...);
+					ReturnShift<ReturnType>()(args, (ptr->*mfptr)(ConvertFromJS<typename std::decay<Args>::type>(args.GetIsolate(), expanded)...));
+				}
+			};
+
+			template <int I, class ThisClass, typename... Args>
+			struct Expander<I, I, ThisClass, void, Args...>
+			{
+				typedef void(ThisClass::*MemberFunctionPtr)(Args...);
+
+				template<class... Expanded>
+				static void expand(ThisClass* ptr, MemberFunctionPtr mfptr, const FunctionCallbackInfo<Value>& args, const Expanded&... expanded)
+				{
+					(ptr->*mfptr)(ConvertFromJS<typename std::decay<Args>::type>(args.GetIsolate(), expanded)...);
 				}
 			};
 #pragma endregion
@@ -107,7 +153,7 @@ namespace V8Transmission
 	/// 	int sum(int x, int y) { return x+y; }
 	/// 	
 	/// 	...
-	/// 	global->Set(String::NewFromUtf8(isolate, "sum"), FunctionTemplate::New(isolate, StaticFunctionGear<int, int, int>::Invoke<sum>));
+	/// 	StaticFunctionGear<int, int, int>::Bind<sum>(isolate, global, "sum");
 	///		...
 	/// 
 	/// </summary>
@@ -123,19 +169,19 @@ namespace V8Transmission
 		template <StaticFunctionPtr sfptr>
 		static void Invoke(const FunctionCallbackInfo<Value>& args)
 		{
+			V8T_TRACE_GEAR(args, "StaticFunctionGear");
+
 			Internal::Convert_Expand_Execute_Raw_Function_Pointer::Expander<0, sizeof...(ArgumentTypes), ReturnType, ArgumentTypes...>::expand(sfptr, args);
 		}
 
-		//global->Set(String::NewFromUtf8(isolate, "gear"), FunctionTemplate::New(isolate, StaticFunctionGear<int, std::string, std::string>::Invoke<xc>));
-
-
+		/** Sets the function on tmpl under name, which is also what profiles and stack traces show for it. */
 		template <StaticFunctionPtr sfptr>
-		static void Bind(Isolate* iso, const char* name)
+		static void Bind(Isolate* iso, const Handle<ObjectTemplate>& tmpl, const char* name)
 		{
-			Local<ObjectTemplate> protoTmpl = Local<ObjectTemplate>::New(iso, ClassGear<ThisClass>::PrototypeTemplate);
-			Local<FunctionTemplate> lft = FunctionTemplate::New(iso, Invoke<mfptr>);
+			Local<FunctionTemplate> lft = FunctionTemplate::New(iso, Invoke<sfptr>);
+			lft->SetClassName(v8::String::NewFromUtf8(iso, name));
 
-			protoTmpl->Set(String::NewFromUtf8(iso, name), lft);
+			tmpl->Set(v8::String::NewFromUtf8(iso, name), lft);
 		}
 	};
 
@@ -158,12 +204,15 @@ namespace V8Transmission
 		template <MemberFunctionPtr mfptr>
 		static void Invoke(const FunctionCallbackInfo<Value>& args)
 		{
-			ThisClass* this_ptr = ConvertFromJS<ThisClass*>(args.GetIsolate(), args.Holder());
+			V8T_TRACE_GEAR(args, "MemberFunctionGear");
+
+			// Bind's Signature has V8 reject foreign receivers before we get here, Holder() is always a wrapper.
+			ThisClass* this_ptr = ClassGear<ThisClass>::UnwrapUnchecked(args.GetIsolate(), args.Holder());
 
 			if (this_ptr)
 				Internal::Convert_Expand_Execute_Member_Function_Pointer::Expander<0, sizeof...(ArgumentTypes), ThisClass, ReturnType, ArgumentTypes...>::expand(this_ptr, mfptr, args);
-
-			// TODO: Else some sort of error to avoid dereferencing a null pointer.
+			else
+				ClassGear<ThisClass>::ThrowReleased(args.GetIsolate());
 		}
 
 		////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -179,10 +228,11 @@ namespace V8Transmission
 		template <MemberFunctionPtr mfptr>
 		static void Bind(Isolate* iso, const char* name)
 		{
-			Local<ObjectTemplate> protoTmpl = Local<ObjectTemplate>::New(iso, ClassGear<ThisClass>::PrototypeTemplate);
-			Local<FunctionTemplate> lft = FunctionTemplate::New(iso, Invoke<mfptr>);
+			Local<ObjectTemplate> protoTmpl = ClassGear<ThisClass>::PrototypeTemplate(iso);
+			Local<FunctionTemplate> lft = FunctionTemplate::New(iso, Invoke<mfptr>, Handle<Value>(), ClassGear<ThisClass>::ReceiverSignature(iso));
+			lft->SetClassName(v8::String::NewFromUtf8(iso, name));
 
-			protoTmpl->Set(String::NewFromUtf8(iso, name), lft);
+			protoTmpl->Set(v8::String::NewFromUtf8(iso, name), lft);
 		}
 	};
 }
\ No newline at end of file
@@ -0,0 +1,148 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+///	The MIT License (MIT)
+///
+///	Copyright (c) 2014 Gregory Hlavac
+///
+///	Permission is hereby granted, free of charge, to any person obtaining a copy
+///	of this software and associated documentation files (the "Software"), to deal
+///	in the Software without restriction, including without limitation the rights
+///	to use, copy, modify, merge, publish, distribute, sub-license, and/or sell
+///	copies of the Software, and to permit persons to whom the Software is
+///	furnished to do so, subject to the following conditions:
+///
+///	The above copyright notice and this permission notice shall be included in
+///	all copies or substantial portions of the Software.
+///
+///	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+///	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+///	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+///	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+///	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+///	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+///	THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+#pragma once
+
+#include <v8.h>
+
+#include <cmath>
+#include <chrono>
+#include <vector>
+#include <utility>
+#include <stdint.h>
+#include <algorithm>
+#include <functional>
+
+#include "Common.h"
+
+namespace V8Transmission
+{
+	namespace Timing
+	{
+		typedef std::chrono::steady_clock Clock;
+
+		inline double ElapsedMs(Clock::time_point from, Clock::time_point to)
+		{
+			return std::chrono::duration<double, std::milli>(to - from).count();
+		}
+
+		/** Microseconds on the steady clock, the timebase of trace events and GC pause starts. */
+		inline uint64_t NowMicros()
+		{
+			return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now().time_since_epoch()).count());
+		}
+
+		/** Nearest-rank percentile of samples sorted in ascending order, 0 if there are none. */
+		inline double Percentile(const std::vector<double>& sorted, double p)
+		{
+			if (sorted.empty())
+				return 0;
+
+			size_t rank = static_cast<size_t>(std::ceil(p * sorted.size()));
+
+			return sorted[rank == 0 ? 0 : std::min(rank, sorted.size()) - 1];
+		}
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	/// <summary>
+	/// 	Times every GC of an isolate from one prologue/epilogue pair and hands each pause to its
+	/// 	listeners, so tracing, heap policies and benchmarks share that registration instead of
+	/// 	each timing GCs on their own.
+	/// 	
+	/// 	The callbacks are added with the first listener and removed with the last. Listeners are
+	/// 	called on the isolate's thread, and must not add or remove listeners from the call.
+	/// </summary>
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	class GCPauses
+	{
+	public:
+		/** Called after each GC with its type, when it started (Timing::NowMicros) and how long it took. */
+		typedef std::function<void(v8::Isolate*, v8::GCType, uint64_t startMicros, double pauseMs)> Listener;
+
+		GCPauses() : started(0), nextId(1) {}
+
+		static GCPauses& ForIsolate(v8::Isolate* iso)
+		{
+			return IsolateData::Get(iso).Slot<GCPauses>();
+		}
+
+		/** Adds a listener, returns the id to remove it with. */
+		int Add(v8::Isolate* iso, Listener listener)
+		{
+			if (listeners.empty())
+			{
+				iso->AddGCPrologueCallback(OnGCPrologue);
+				iso->AddGCEpilogueCallback(OnGCEpilogue);
+			}
+
+			listeners.push_back(std::make_pair(nextId, std::move(listener)));
+
+			return nextId++;
+		}
+
+		void Remove(v8::Isolate* iso, int id)
+		{
+			for (size_t i = 0; i < listeners.size(); i++)
+			{
+				if (listeners[i].first == id)
+				{
+					listeners.erase(listeners.begin() + i);
+					break;
+				}
+			}
+
+			if (listeners.empty())
+			{
+				iso->RemoveGCPrologueCallback(OnGCPrologue);
+				iso->RemoveGCEpilogueCallback(OnGCEpilogue);
+			}
+		}
+
+	private:
+		uint64_t								started;
+		int										nextId;
+		std::vector<std::pair<int, Listener> >	listeners;
+
+		static void OnGCPrologue(v8::Isolate* iso, v8::GCType type, v8::GCCallbackFlags flags)
+		{
+			ForIsolate(iso).started = Timing::NowMicros();
+		}
+
+		static void OnGCEpilogue(v8::Isolate* iso, v8::GCType type, v8::GCCallbackFlags flags)
+		{
+			GCPauses& pauses = ForIsolate(iso);
+
+			if (pauses.started == 0)
+				return;
+
+			uint64_t started = pauses.started;
+			double pauseMs = (Timing::NowMicros() - started) / 1000.0;
+			pauses.started = 0;
+
+			for (size_t i = 0; i < pauses.listeners.size(); i++)
+				pauses.listeners[i].second(iso, type, started, pauseMs);
+		}
+	};
+}
@@ -0,0 +1,896 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+///	The MIT License (MIT)
+///
+///	Copyright (c) 2014 Gregory Hlavac
+///
+///	Permission is hereby granted, free of charge, to any person obtaining a copy
+///	of this software and associated documentation files (the "Software"), to deal
+///	in the Software without restriction, including without limitation the rights
+///	to use, copy, modify, merge, publish, distribute, sub-license, and/or sell
+///	copies of the Software, and to permit persons to whom the Software is
+///	furnished to do so, subject to the following conditions:
+///
+///	The above copyright notice and this permission notice shall be included in
+///	all copies or substantial portions of the Software.
+///
+///	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+///	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+///	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+///	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+///	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+///	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+///	THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <v8.h>
+
+#include <map>
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <string.h>
+
+#include "Common.h"
+#include "ClassGears.h"
+#include "ArrayViewGears.h"
+#include "OwnershipPolicies.h"
+
+using v8::Value;
+using v8::Local;
+using v8::Handle;
+using v8::Object;
+using v8::Isolate;
+using v8::External;
+using v8::Persistent;
+
+namespace V8Transmission
+{
+	namespace Transfer
+	{
+		/** How a bound type crosses over to another isolate, see ClassTransfer<T>::Enable. */
+		enum Mode
+		{
+			/** The native object moves, the sending wrapper must own it (Unique or FactoryOwned) and is left empty. */
+			Move,
+			/** Both wrappers hold a std::shared_ptr reference to the same object, the sender must be Shared. */
+			Share,
+			/** The object is written with CO_TransferSerializer<T> and read back into a new, owned object. */
+			Serialize
+		};
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	/// <summary>
+	/// 	A ClassOption providing the per-class hook for Transfer::Serialize, specialize it with
+	/// 	
+	/// 	static void Write(const T& obj, std::string& bytes);
+	/// 	static std::unique_ptr<T> Read(const std::string& bytes);
+	/// </summary>
+	///
+	/// <typeparam name="T">	Generic type parameter. </typeparam>
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	template <typename T>
+	struct CO_TransferSerializer;
+
+	namespace Internal
+	{
+		struct TransferHook;
+
+		/** What a bound object left behind in a TransferMessage. */
+		struct HostPayload
+		{
+			const TransferHook*		hook;
+			void*					ptr;
+			/** For a moved ptr, whether the sender held it through its factory rather than a std::unique_ptr. */
+			bool					factoryOwned;
+			std::shared_ptr<void>	shared;
+			std::string				bytes;
+			bool					consumed;
+
+			HostPayload() : hook(nullptr), ptr(nullptr), factoryOwned(false), consumed(false) {}
+		};
+
+		struct TransferHook
+		{
+			/** Whether Write would succeed, without touching the object, so nothing moves before the whole value is known to be transferable. */
+			bool(*Check)(Isolate*, Handle<Object>);
+			/** Takes the object out of its wrapper into the payload, false if it can't be transferred. */
+			bool(*Write)(Isolate*, Handle<Object>, HostPayload&);
+			/** Builds the wrapper for the payload in the receiving isolate. */
+			Handle<Object>(*Read)(Isolate*, HostPayload&);
+			/** Frees a payload that was never received. */
+			void(*Discard)(HostPayload&);
+		};
+
+		class TransferRegistry
+		{
+		public:
+			static void Register(const std::string* identifier, const TransferHook* hook)
+			{
+				std::lock_guard<std::mutex> guard(Lock());
+				Hooks()[identifier] = hook;
+			}
+
+			static const TransferHook* Find(const std::string* identifier)
+			{
+				std::lock_guard<std::mutex> guard(Lock());
+
+				std::map<const std::string*, const TransferHook*>::const_iterator it = Hooks().find(identifier);
+
+				return it == Hooks().end() ? nullptr : it->second;
+			}
+
+		private:
+			static std::mutex& Lock()
+			{
+				static std::mutex lock;
+				return lock;
+			}
+
+			static std::map<const std::string*, const TransferHook*>& Hooks()
+			{
+				static std::map<const std::string*, const TransferHook*> hooks;
+				return hooks;
+			}
+		};
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	/// <summary>
+	/// 	Opts a bound type in to IsolateTransfer, without it wrapped objects of that type refuse to be
+	/// 	transferred.
+	/// 	
+	/// 	Example
+	/// 	
+	/// 	ClassTransfer<GraphNode>::Enable(Transfer::Share);
+	/// </summary>
+	///
+	/// <typeparam name="NativeType"> 	The bound type. </typeparam>
+	/// <typeparam name="TypeFactory">	The bound type's factory, as given to its ClassGear. </typeparam>
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	template <typename NativeType, typename TypeFactory = CO_NativeTypeFactory<NativeType> >
+	struct ClassTransfer
+	{
+		typedef ClassGear<NativeType, TypeFactory> CG;
+		typedef Ownership::Unique<NativeType> UniquePolicy;
+		typedef Ownership::Shared<NativeType> SharedPolicy;
+		typedef Ownership::FactoryOwned<NativeType, TypeFactory> FactoryPolicy;
+
+		static void Enable(Transfer::Mode mode)
+		{
+			static const Internal::TransferHook moveHook = { CheckMove, WriteMove, ReadMove, DiscardMove };
+			static const Internal::TransferHook shareHook = { CheckShare, WriteShare, ReadShare, DiscardHeld };
+			static const Internal::TransferHook serializeHook = { CheckSerialized, WriteSerialized, ReadSerialized, DiscardHeld };
+
+			const Internal::TransferHook* hook = &moveHook;
+
+			if (mode == Transfer::Share)
+				hook = &shareHook;
+			else if (mode == Transfer::Serialize)
+				hook = &serializeHook;
+
+			Internal::TransferRegistry::Register(CO_Identifier<NativeType>::Value(), hook);
+		}
+
+	private:
+		static Internal::WrapperCellBase* Cell(Isolate* iso, Handle<Object> obj)
+		{
+			Handle<Value> cell = obj->GetHiddenValue(CG::CellKey(iso));
+
+			if (cell.IsEmpty() || !cell->IsExternal())
+				return nullptr;
+
+			return static_cast<Internal::WrapperCellBase*>(Handle<External>::Cast(cell)->Value());
+		}
+
+		/** Leaves the sending wrapper pointing at nothing, gears called on it see a null this and its array views are neutered. */
+		static void Empty(Isolate* iso, Handle<Object> obj)
+		{
+			Internal::NativeViews::Detach(iso, obj);
+			obj->SetInternalField(CG::PointerField, External::New(iso, nullptr));
+			obj->DeleteHiddenValue(CG::CellKey(iso));
+		}
+
+		static bool CheckMove(Isolate* iso, Handle<Object> obj)
+		{
+			Internal::WrapperCellBase* base = Cell(iso, obj);
+
+			if (typename CG::template WrapperCell<UniquePolicy>* cell = dynamic_cast<typename CG::template WrapperCell<UniquePolicy>*>(base))
+				return cell->ref != nullptr;
+
+			if (typename CG::template WrapperCell<FactoryPolicy>* cell = dynamic_cast<typename CG::template WrapperCell<FactoryPolicy>*>(base))
+				return cell->ref != nullptr;
+
+			return false;
+		}
+
+		static bool WriteMove(Isolate* iso, Handle<Object> obj, Internal::HostPayload& payload)
+		{
+			Internal::WrapperCellBase* base = Cell(iso, obj);
+
+			if (typename CG::template WrapperCell<UniquePolicy>* cell = dynamic_cast<typename CG::template WrapperCell<UniquePolicy>*>(base))
+			{
+				payload.ptr = cell->ref.release();
+				payload.factoryOwned = false;
+				Internal::CensusDisowned<NativeType>(iso, cell->retained);
+			}
+			else if (typename CG::template WrapperCell<FactoryPolicy>* cell = dynamic_cast<typename CG::template WrapperCell<FactoryPolicy>*>(base))
+			{
+				payload.ptr = cell->ref;
+				payload.factoryOwned = true;
+				cell->ref = nullptr;
+				Internal::CensusDisowned<NativeType>(iso, cell->retained);
+			}
+			else
+			{
+				return false;
+			}
+
+			Empty(iso, obj);
+
+			return payload.ptr != nullptr;
+		}
+
+		/** Rewraps under the policy the sender held it with, the object goes back to whatever allocated it. */
+		static Handle<Object> ReadMove(Isolate* iso, Internal::HostPayload& payload)
+		{
+			NativeType* ptr = static_cast<NativeType*>(payload.ptr);
+
+			if (payload.factoryOwned)
+				return CG::template WrapWith<FactoryPolicy>(iso, ptr);
+
+			return CG::template WrapWith<UniquePolicy>(iso, std::unique_ptr<NativeType>(ptr));
+		}
+
+		static void DiscardMove(Internal::HostPayload& payload)
+		{
+			NativeType* ptr = static_cast<NativeType*>(payload.ptr);
+
+			if (payload.factoryOwned)
+				TypeFactory::Destruct(ptr);
+			else
+				delete ptr;
+		}
+
+		static bool CheckShare(Isolate* iso, Handle<Object> obj)
+		{
+			typename CG::template WrapperCell<SharedPolicy>* cell = dynamic_cast<typename CG::template WrapperCell<SharedPolicy>*>(Cell(iso, obj));
+
+			return cell != nullptr && cell->ref;
+		}
+
+		static bool WriteShare(Isolate* iso, Handle<Object> obj, Internal::HostPayload& payload)
+		{
+			typename CG::template WrapperCell<SharedPolicy>* cell = dynamic_cast<typename CG::template WrapperCell<SharedPolicy>*>(Cell(iso, obj));
+
+			if (cell == nullptr || !cell->ref)
+				return false;
+
+			payload.shared = std::static_pointer_cast<void>(cell->ref);
+
+			return true;
+		}
+
+		static Handle<Object> ReadShare(Isolate* iso, Internal::HostPayload& payload)
+		{
+			return CG::Wrap(iso, std::static_pointer_cast<NativeType>(payload.shared));
+		}
+
+		static void DiscardHeld(Internal::HostPayload& payload)
+		{
+			payload.shared.reset();
+			payload.bytes.clear();
+		}
+
+		static bool CheckSerialized(Isolate* iso, Handle<Object> obj)
+		{
+			return CG::Unwrap(iso, obj) != nullptr;
+		}
+
+		static bool WriteSerialized(Isolate* iso, Handle<Object> obj, Internal::HostPayload& payload)
+		{
+			NativeType* ptr = CG::Unwrap(iso, obj);
+
+			if (ptr == nullptr)
+				return false;
+
+			CO_TransferSerializer<NativeType>::Write(*ptr, payload.bytes);
+
+			return true;
+		}
+
+		static Handle<Object> ReadSerialized(Isolate* iso, Internal::HostPayload& payload)
+		{
+			return CG::Wrap(iso, CO_TransferSerializer<NativeType>::Read(payload.bytes));
+		}
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	/// <summary>
+	/// 	A value lifted out of one isolate by IsolateTransfer::Serialize, waiting to be rebuilt in
+	/// 	another. It owns whatever it carries (moved native objects, array buffer memory) until it
+	/// 	has been deserialized, and frees it if it never is.
+	/// </summary>
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	class TransferMessage
+	{
+	public:
+		explicit TransferMessage(v8::ArrayBuffer::Allocator* allocator) : allocator(allocator), read(false) {}
+
+		~TransferMessage()
+		{
+			for (size_t i = 0; i < hosts.size(); i++)
+			{
+				if (!hosts[i].consumed)
+					hosts[i].hook->Discard(hosts[i]);
+			}
+
+			for (size_t i = 0; i < buffers.size(); i++)
+			{
+				if (!buffers[i].consumed && buffers[i].data != nullptr)
+					allocator->Free(buffers[i].data, buffers[i].length);
+			}
+		}
+
+	private:
+		friend class IsolateTransfer;
+
+		TransferMessage(const TransferMessage&);
+		TransferMessage& operator=(const TransferMessage&);
+
+		enum Kind
+		{
+			K_Undefined, K_Null, K_Boolean, K_Number, K_String, K_Date,
+			K_Array, K_Object, K_Reference, K_ArrayBuffer, K_ArrayBufferView, K_HostObject
+		};
+
+		enum ViewKind
+		{
+			V_Uint8, V_Uint8Clamped, V_Int8, V_Uint16, V_Int16, V_Uint32, V_Int32, V_Float32, V_Float64, V_DataView
+		};
+
+		struct Node
+		{
+			Kind						kind;
+			double						number;
+			std::string					text;
+			uint32_t					index;
+			uint32_t					view;
+			size_t						offset;
+			size_t						length;
+			std::vector<std::string>	keys;
+			std::vector<Node>			children;
+
+			Node() : kind(K_Undefined), number(0), index(0), view(0), offset(0), length(0) {}
+		};
+
+		struct Buffer
+		{
+			void*	data;
+			size_t	length;
+			bool	consumed;
+		};
+
+		Node								root;
+		std::vector<Internal::HostPayload>	hosts;
+		std::vector<Buffer>					buffers;
+		v8::ArrayBuffer::Allocator*			allocator;
+		bool								read;
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	/// <summary>
+	/// 	Moves values between isolates in the same process without going through JSON.
+	/// 	
+	/// 	Primitives, strings, dates, arrays and plain objects are copied (shared references and cycles
+	/// 	are kept), array buffers and their typed array views are transferred by handing the backing
+	/// 	store over and neutering the sender's buffer, and ClassGear wrapped objects are handled by
+	/// 	the hook their type registered with ClassTransfer<T>::Enable.
+	/// 	
+	/// 	The isolate's V8 has no ValueSerializer yet, so this walks the value itself, but the per-class
+	/// 	hooks have the same shape as WriteHostObject/ReadHostObject delegates.
+	/// 	
+	/// 	The allocator has to be the one the isolates were set up with, transferred buffers are
+	/// 	allocated and freed through it.
+	/// </summary>
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	class IsolateTransfer
+	{
+	public:
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		/// <summary>
+		/// 	Lifts a value out of the current isolate, must run on that isolate's thread inside a
+		/// 	HandleScope. On failure a DataCloneError is thrown into the isolate and nullptr returned.
+		/// </summary>
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		static std::unique_ptr<TransferMessage> Serialize(Isolate* iso, Handle<Value> value, v8::ArrayBuffer::Allocator* allocator)
+		{
+			std::unique_ptr<TransferMessage> message(new TransferMessage(allocator));
+			Writer writer(iso, *message);
+
+			// The walk only checks and records, the sender loses nothing unless all of it can be sent.
+			if (!writer.Write(value, message->root) || !writer.Commit())
+			{
+				iso->ThrowException(v8::Exception::Error(v8::String::NewFromUtf8(iso, ("DataCloneError: " + writer.error).c_str())));
+				return nullptr;
+			}
+
+			return message;
+		}
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		/// <summary>
+		/// 	Rebuilds a message in the current isolate and context, handing everything it owned over to
+		/// 	the new isolate. A message can only be deserialized once, reading it again throws a
+		/// 	DataCloneError into the isolate and returns an empty handle.
+		/// </summary>
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		static Handle<Value> Deserialize(Isolate* iso, TransferMessage& message)
+		{
+			if (message.read)
+				return Refuse(iso, "the message has already been deserialized");
+
+			message.read = true;
+
+			Reader reader(iso, message);
+			Handle<Value> value = reader.Read(message.root);
+
+			if (reader.failed)
+				return Refuse(iso, "the message hands over something it no longer owns");
+
+			return value;
+		}
+
+	private:
+		typedef TransferMessage::Node Node;
+
+		static Handle<Value> Refuse(Isolate* iso, const char* reason)
+		{
+			iso->ThrowException(v8::Exception::Error(v8::String::NewFromUtf8(iso, (std::string("DataCloneError: ") + reason).c_str())));
+			return Handle<Value>();
+		}
+
+		struct Writer
+		{
+			struct PendingHost
+			{
+				Local<Object>					obj;
+				const Internal::TransferHook*	hook;
+			};
+
+			Isolate*						iso;
+			TransferMessage&				message;
+			std::string						error;
+			std::multimap<int, uint32_t>	seenObjects;
+			std::vector<Local<Object> >		objects;
+			std::vector<Local<v8::ArrayBuffer> >	arrayBuffers;
+			std::vector<PendingHost>		hosts;
+
+			Writer(Isolate* iso, TransferMessage& message) : iso(iso), message(message) {}
+
+			////////////////////////////////////////////////////////////////////////////////////////////////////
+			/// <summary>
+			/// 	Second pass, once Write got through the whole value: takes the bound objects out of their
+			/// 	wrappers and the buffers out of the sender. Every hook's Check already passed, so a Write
+			/// 	failing here means a Check that doesn't match its Write.
+			/// </summary>
+			////////////////////////////////////////////////////////////////////////////////////////////////////
+			bool Commit()
+			{
+				for (size_t i = 0; i < hosts.size(); i++)
+				{
+					Internal::HostPayload payload;
+					payload.hook = hosts[i].hook;
+
+					if (!hosts[i].hook->Write(iso, hosts[i].obj, payload))
+					{
+						error = "bound object couldn't be taken out of its wrapper.";
+						return false;
+					}
+
+					message.hosts.push_back(payload);
+				}
+
+				for (size_t i = 0; i < arrayBuffers.size(); i++)
+				{
+					Local<v8::ArrayBuffer> buffer = arrayBuffers[i];
+					TransferMessage::Buffer entry = { nullptr, buffer->ByteLength(), false };
+
+					if (buffer->IsExternal())
+					{
+						// Memory somebody else already owns can't be handed over, copy it instead. Externalizing
+						// it a second time fails V8's API check.
+						entry.data = message.allocator->AllocateUninitialized(entry.length);
+						memcpy(entry.data, buffer->GetContents().Data(), entry.length);
+					}
+					else
+					{
+						entry.data = buffer->Externalize().Data();
+						buffer->Neuter();
+					}
+
+					message.buffers.push_back(entry);
+				}
+
+				return true;
+			}
+
+			bool Write(Handle<Value> value, Node& node)
+			{
+				if (value->IsUndefined())
+				{
+					node.kind = TransferMessage::K_Undefined;
+				}
+				else if (value->IsNull())
+				{
+					node.kind = TransferMessage::K_Null;
+				}
+				else if (value->IsBoolean())
+				{
+					node.kind = TransferMessage::K_Boolean;
+					node.number = value->BooleanValue() ? 1 : 0;
+				}
+				else if (value->IsNumber())
+				{
+					node.kind = TransferMessage::K_Number;
+					node.number = value->NumberValue();
+				}
+				else if (value->IsString())
+				{
+					v8::String::Utf8Value utf8(value);
+
+					node.kind = TransferMessage::K_String;
+					node.text.assign(*utf8, utf8.length());
+				}
+				else if (value->IsDate())
+				{
+					node.kind = TransferMessage::K_Date;
+					node.number = value->NumberValue();
+				}
+				else if (value->IsArrayBuffer())
+				{
+					node.kind = TransferMessage::K_ArrayBuffer;
+					node.index = TransferBuffer(Handle<v8::ArrayBuffer>::Cast(value));
+				}
+				else if (value->IsArrayBufferView())
+				{
+					return WriteView(Handle<v8::ArrayBufferView>::Cast(value), node);
+				}
+				else if (value->IsObject() && !value->IsFunction())
+				{
+					return WriteObject(value->ToObject(), node);
+				}
+				else
+				{
+					error = "value could not be cloned.";
+					return false;
+				}
+
+				return true;
+			}
+
+			bool WriteObject(Local<Object> obj, Node& node)
+			{
+				// A second path to an object already written becomes a reference to it, which also keeps
+				// cycles from recursing forever.
+				int hash = obj->GetIdentityHash();
+
+				for (std::multimap<int, uint32_t>::iterator it = seenObjects.lower_bound(hash); it != seenObjects.upper_bound(hash); ++it)
+				{
+					if (objects[it->second]->StrictEquals(obj))
+					{
+						node.kind = TransferMessage::K_Reference;
+						node.index = it->second;
+						return true;
+					}
+				}
+
+				node.index = static_cast<uint32_t>(objects.size());
+				seenObjects.insert(std::make_pair(hash, node.index));
+				objects.push_back(obj);
+
+				if (obj->InternalFieldCount() != 0)
+					return WriteHost(obj, node);
+
+				Local<v8::Array> keys = obj->GetOwnPropertyNames();
+
+				if (obj->IsArray())
+				{
+					Local<v8::Array> arr = Local<v8::Array>::Cast(obj);
+
+					node.kind = TransferMessage::K_Array;
+					node.children.resize(arr->Length());
+
+					for (uint32_t i = 0; i < arr->Length(); i++)
+					{
+						if (!Write(arr->Get(i), node.children[i]))
+							return false;
+					}
+
+					return true;
+				}
+
+				node.kind = TransferMessage::K_Object;
+				node.keys.resize(keys->Length());
+				node.children.resize(keys->Length());
+
+				for (uint32_t i = 0; i < keys->Length(); i++)
+				{
+					Local<Value> key = keys->Get(i);
+					v8::String::Utf8Value utf8(key);
+
+					node.keys[i].assign(*utf8, utf8.length());
+
+					if (!Write(obj->Get(key), node.children[i]))
+						return false;
+				}
+
+				return true;
+			}
+
+			bool WriteHost(Local<Object> obj, Node& node)
+			{
+				if (obj->InternalFieldCount() < 2)
+				{
+					error = "object has internal fields but wasn't wrapped by a ClassGear.";
+					return false;
+				}
+
+				const std::string* identifier = static_cast<const std::string*>(Local<External>::Cast(obj->GetInternalField(1))->Value());
+				const Internal::TransferHook* hook = Internal::TransferRegistry::Find(identifier);
+
+				if (hook == nullptr)
+				{
+					error = "bound type " + *identifier + " hasn't been enabled with ClassTransfer.";
+					return false;
+				}
+
+				if (!hook->Check(iso, obj))
+				{
+					error = "bound " + *identifier + " isn't held in a way its transfer mode allows.";
+					return false;
+				}
+
+				PendingHost pending = { obj, hook };
+
+				node.kind = TransferMessage::K_HostObject;
+				node.offset = hosts.size();
+				hosts.push_back(pending);
+
+				return true;
+			}
+
+			bool WriteView(Handle<v8::ArrayBufferView> view, Node& node)
+			{
+				node.kind = TransferMessage::K_ArrayBufferView;
+				node.offset = view->ByteOffset();
+				node.length = view->ByteLength();
+
+				if (view->IsUint8Array())				node.view = TransferMessage::V_Uint8;
+				else if (view->IsUint8ClampedArray())	node.view = TransferMessage::V_Uint8Clamped;
+				else if (view->IsInt8Array())			node.view = TransferMessage::V_Int8;
+				else if (view->IsUint16Array())			node.view = TransferMessage::V_Uint16;
+				else if (view->IsInt16Array())			node.view = TransferMessage::V_Int16;
+				else if (view->IsUint32Array())			node.view = TransferMessage::V_Uint32;
+				else if (view->IsInt32Array())			node.view = TransferMessage::V_Int32;
+				else if (view->IsFloat32Array())		node.view = TransferMessage::V_Float32;
+				else if (view->IsFloat64Array())		node.view = TransferMessage::V_Float64;
+				else									node.view = TransferMessage::V_DataView;
+
+				// Views of the same buffer share one transferred buffer on the other side as well.
+				node.index = TransferBuffer(view->Buffer());
+
+				return true;
+			}
+
+			uint32_t TransferBuffer(Handle<v8::ArrayBuffer> buffer)
+			{
+				for (size_t i = 0; i < arrayBuffers.size(); i++)
+				{
+					if (arrayBuffers[i]->StrictEquals(buffer))
+						return static_cast<uint32_t>(i);
+				}
+
+				// Taken out of the sender by Commit, buffers are indexed in the order they were first seen.
+				arrayBuffers.push_back(Local<v8::ArrayBuffer>::New(iso, buffer));
+
+				return static_cast<uint32_t>(arrayBuffers.size() - 1);
+			}
+		};
+
+		struct Reader
+		{
+			Isolate*					iso;
+			TransferMessage&			message;
+			std::vector<Local<Object> >	objects;
+			std::vector<Local<v8::ArrayBuffer> > arrayBuffers;
+			bool						failed;
+
+			Reader(Isolate* iso, TransferMessage& message) : iso(iso), message(message), arrayBuffers(message.buffers.size()), failed(false) {}
+
+			Handle<Value> Read(Node& node)
+			{
+				switch (node.kind)
+				{
+				case TransferMessage::K_Undefined:	return v8::Undefined(iso);
+				case TransferMessage::K_Null:		return v8::Null(iso);
+				case TransferMessage::K_Boolean:	return v8::Boolean::New(iso, node.number != 0);
+				case TransferMessage::K_Number:		return v8::Number::New(iso, node.number);
+				case TransferMessage::K_Date:		return v8::Date::New(iso, node.number);
+				case TransferMessage::K_String:		return v8::String::NewFromUtf8(iso, node.text.c_str(), v8::String::kNormalString, static_cast<int>(node.text.size()));
+				case TransferMessage::K_Reference:	return objects[node.index];
+				case TransferMessage::K_ArrayBuffer: return Buffer(node.index);
+				case TransferMessage::K_ArrayBufferView: return View(node);
+
+				case TransferMessage::K_HostObject:
+					{
+						Internal::HostPayload& payload = message.hosts[node.offset];
+
+						// Someone else already owns what it pointed to.
+						if (payload.consumed)
+						{
+							failed = true;
+							return v8::Undefined(iso);
+						}
+
+						payload.consumed = true;
+
+						Local<Object> obj = Local<Object>::New(iso, payload.hook->Read(iso, payload));
+						objects.push_back(obj);
+						return obj;
+					}
+
+				case TransferMessage::K_Array:
+					{
+						Local<v8::Array> arr = v8::Array::New(iso, static_cast<int>(node.children.size()));
+						objects.push_back(arr);
+
+						for (size_t i = 0; i < node.children.size(); i++)
+							arr->Set(static_cast<uint32_t>(i), Read(node.children[i]));
+
+						return arr;
+					}
+
+				case TransferMessage::K_Object:
+				default:
+					{
+						Local<Object> obj = Object::New(iso);
+						objects.push_back(obj);
+
+						for (size_t i = 0; i < node.children.size(); i++)
+						{
+							obj->Set(v8::String::NewFromUtf8(iso, node.keys[i].c_str(), v8::String::kNormalString, static_cast<int>(node.keys[i].size())),
+								Read(node.children[i]));
+						}
+
+						return obj;
+					}
+				}
+			}
+
+			Local<v8::ArrayBuffer> Buffer(uint32_t index)
+			{
+				if (arrayBuffers[index].IsEmpty())
+				{
+					TransferMessage::Buffer& entry = message.buffers[index];
+
+					if (entry.consumed)
+					{
+						failed = true;
+						arrayBuffers[index] = v8::ArrayBuffer::New(iso, 0);
+						return arrayBuffers[index];
+					}
+
+					entry.consumed = true;
+
+					arrayBuffers[index] = v8::ArrayBuffer::New(iso, entry.data, entry.length);
+
+					// The new buffer is external, its memory goes back to the allocator once it is collected.
+					BufferCell* cell = new BufferCell;
+					cell->allocator = message.allocator;
+					cell->data = entry.data;
+					cell->length = entry.length;
+					cell->handle.Reset(iso, arrayBuffers[index]);
+					cell->handle.SetWeak(cell, FreeBuffer);
+				}
+
+				return arrayBuffers[index];
+			}
+
+			Handle<Value> View(Node& node)
+			{
+				Local<v8::ArrayBuffer> buffer = Buffer(node.index);
+
+				switch (node.view)
+				{
+				case TransferMessage::V_Uint8:			return v8::Uint8Array::New(buffer, node.offset, node.length);
+				case TransferMessage::V_Uint8Clamped:	return v8::Uint8ClampedArray::New(buffer, node.offset, node.length);
+				case TransferMessage::V_Int8:			return v8::Int8Array::New(buffer, node.offset, node.length);
+				case TransferMessage::V_Uint16:			return v8::Uint16Array::New(buffer, node.offset, node.length / 2);
+				case TransferMessage::V_Int16:			return v8::Int16Array::New(buffer, node.offset, node.length / 2);
+				case TransferMessage::V_Uint32:			return v8::Uint32Array::New(buffer, node.offset, node.length / 4);
+				case TransferMessage::V_Int32:			return v8::Int32Array::New(buffer, node.offset, node.length / 4);
+				case TransferMessage::V_Float32:		return v8::Float32Array::New(buffer, node.offset, node.length / 4);
+				case TransferMessage::V_Float64:		return v8::Float64Array::New(buffer, node.offset, node.length / 8);
+				default:								return v8::DataView::New(buffer, node.offset, node.length);
+				}
+			}
+
+			struct BufferCell
+			{
+				v8::ArrayBuffer::Allocator*		allocator;
+				void*							data;
+				size_t							length;
+				Persistent<v8::ArrayBuffer>		handle;
+			};
+
+			static void FreeBuffer(const v8::WeakCallbackData<v8::ArrayBuffer, BufferCell>& data)
+			{
+				BufferCell* cell = data.GetParameter();
+
+				cell->allocator->Free(cell->data, cell->length);
+				cell->handle.Reset();
+
+				delete cell;
+			}
+		};
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	/// <summary>
+	/// 	A one way, thread safe message channel between isolates built on IsolateTransfer. The sending
+	/// 	isolate's thread Posts, the receiving isolate's thread Receives.
+	/// </summary>
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	class IsolateChannel
+	{
+	public:
+		explicit IsolateChannel(v8::ArrayBuffer::Allocator* allocator) : allocator(allocator) {}
+
+		/** Lifts the value out of the sending isolate, false (with a DataCloneError thrown) if it couldn't be. */
+		bool Post(Isolate* iso, Handle<Value> value)
+		{
+			std::unique_ptr<TransferMessage> message = IsolateTransfer::Serialize(iso, value, allocator);
+
+			if (!message)
+				return false;
+
+			std::lock_guard<std::mutex> guard(lock);
+			messages.push_back(std::move(message));
+
+			return true;
+		}
+
+		/** Rebuilds the oldest message in the receiving isolate's current context, false if there was none. */
+		bool TryReceive(Isolate* iso, Local<Value>& value)
+		{
+			std::unique_ptr<TransferMessage> message;
+
+			{
+				std::lock_guard<std::mutex> guard(lock);
+
+				if (messages.empty())
+					return false;
+
+				message = std::move(messages.front());
+				messages.pop_front();
+			}
+
+			value = Local<Value>::New(iso, IsolateTransfer::Deserialize(iso, *message));
+
+			return true;
+		}
+
+	private:
+		IsolateChannel(const IsolateChannel&);
+		IsolateChannel& operator=(const IsolateChannel&);
+
+		v8::ArrayBuffer::Allocator*						allocator;
+		std::mutex										lock;
+		std::deque<std::unique_ptr<TransferMessage> >	messages;
+	};
+}
@@ -0,0 +1,451 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+///	The MIT License (MIT)
+///
+///	Copyright (c) 2014 Gregory Hlavac
+///
+///	Permission is hereby granted, free of charge, to any person obtaining a copy
+///	of this software and associated documentation files (the "Software"), to deal
+///	in the Software without restriction, including without limitation the rights
+///	to use, copy, modify, merge, publish, distribute, sub-license, and/or sell
+///	copies of the Software, and to permit persons to whom the Software is
+///	furnished to do so, subject to the following conditions:
+///
+///	The above copyright notice and this permission notice shall be included in
+///	all copies or substantial portions of the Software.
+///
+///	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+///	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+///	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+///	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+///	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+///	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+///	THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <v8.h>
+
+#include <memory>
+#include <utility>
+#include <functional>
+
+#include "Common.h"
+#include "ClassGears.h"
+
+namespace V8Transmission
+{
+	namespace Internal
+	{
+		/** Pulls the elements of one pass over a native range, converting each as it goes. */
+		class RangeSource
+		{
+		public:
+			virtual ~RangeSource() {}
+
+			/** Converts the next element into out, false once the range is exhausted. */
+			virtual bool Next(v8::Isolate* iso, v8::Handle<v8::Value>& out) = 0;
+		};
+
+		/** Keeps whatever javascript object owns a borrowed range alive while it is iterated. */
+		struct RangeOwner
+		{
+			v8::Persistent<v8::Object>	handle;
+
+			~RangeOwner() { handle.Reset(); }
+		};
+
+		template <typename Iterator>
+		class IteratorRangeSource : public RangeSource
+		{
+		public:
+			IteratorRangeSource(Iterator begin, Iterator end, std::shared_ptr<void> keepAlive)
+				: current(begin), end(end), keepAlive(std::move(keepAlive)) {}
+
+			bool Next(v8::Isolate* iso, v8::Handle<v8::Value>& out)
+			{
+				if (current == end)
+					return false;
+
+				out = ConvertToJS(iso, *current);
+				++current;
+
+				return true;
+			}
+
+		private:
+			Iterator				current;
+			Iterator				end;
+			std::shared_ptr<void>	keepAlive;
+		};
+
+		template <typename T, typename Generator>
+		class GeneratorRangeSource : public RangeSource
+		{
+		public:
+			explicit GeneratorRangeSource(const Generator& generator) : generator(generator) {}
+
+			bool Next(v8::Isolate* iso, v8::Handle<v8::Value>& out)
+			{
+				T value;
+
+				if (!generator(value))
+					return false;
+
+				out = ConvertToJS(iso, std::move(value));
+
+				return true;
+			}
+
+		private:
+			Generator	generator;
+		};
+
+		typedef std::function<RangeSource*()> RangeFactory;
+
+		/** What an iterable or iterator object keeps in its internal field, freed along with it. */
+		template <typename T>
+		struct IterableCell
+		{
+			T							payload;
+			size_t						chunk;
+			v8::Persistent<v8::Object>	handle;
+
+			static void Free(const v8::WeakCallbackData<v8::Object, IterableCell>& data)
+			{
+				IterableCell* cell = data.GetParameter();
+
+				cell->handle.Reset();
+				delete cell;
+			}
+
+			static IterableCell* From(v8::Handle<v8::Object> obj)
+			{
+				if (obj.IsEmpty() || obj->InternalFieldCount() < 1)
+					return nullptr;
+
+				return static_cast<IterableCell*>(obj->GetAlignedPointerFromInternalField(0));
+			}
+		};
+
+		struct IteratorState
+		{
+			std::unique_ptr<RangeSource>	source;
+		};
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		/// <summary>
+		/// 	The iterator protocol over a RangeFactory. The templates are made once per isolate and the
+		/// 	Symbol.iterator key is looked up from the global Symbol, which holds on every V8 that has
+		/// 	one whether or not the embedding API exposes it.
+		/// </summary>
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		class IterationProtocol
+		{
+		public:
+			~IterationProtocol()
+			{
+				iterableTemplate.Reset();
+				iteratorTemplate.Reset();
+				iterateTemplate.Reset();
+				selfTemplate.Reset();
+			}
+
+			static v8::Local<v8::Object> NewIterable(v8::Isolate* iso, RangeFactory factory, size_t chunk)
+			{
+				IterationProtocol& protocol = ForIsolate(iso);
+				v8::Local<v8::Object> obj = v8::Local<v8::ObjectTemplate>::New(iso, protocol.iterableTemplate)->NewInstance();
+
+				IterableCell<RangeFactory>* cell = new IterableCell<RangeFactory>;
+				cell->payload = std::move(factory);
+				cell->chunk = chunk;
+				cell->handle.Reset(iso, obj);
+				cell->handle.SetWeak(cell, IterableCell<RangeFactory>::Free);
+
+				obj->SetAlignedPointerInInternalField(0, cell);
+				SetIteratorMethod(iso, obj, v8::Local<v8::FunctionTemplate>::New(iso, protocol.iterateTemplate));
+
+				return obj;
+			}
+
+		private:
+			v8::Persistent<v8::ObjectTemplate>		iterableTemplate;
+			v8::Persistent<v8::ObjectTemplate>		iteratorTemplate;
+			v8::Persistent<v8::FunctionTemplate>	iterateTemplate;
+			v8::Persistent<v8::FunctionTemplate>	selfTemplate;
+
+			static IterationProtocol& ForIsolate(v8::Isolate* iso)
+			{
+				IterationProtocol& protocol = IsolateData::Get(iso).Slot<IterationProtocol>();
+
+				if (protocol.iterableTemplate.IsEmpty())
+				{
+					v8::Local<v8::ObjectTemplate> iterable = v8::ObjectTemplate::New(iso);
+					iterable->SetInternalFieldCount(1);
+
+					v8::Local<v8::ObjectTemplate> iterator = v8::ObjectTemplate::New(iso);
+					iterator->SetInternalFieldCount(1);
+					iterator->Set(v8::String::NewFromUtf8(iso, "next"), v8::FunctionTemplate::New(iso, Next));
+					iterator->Set(v8::String::NewFromUtf8(iso, "return"), v8::FunctionTemplate::New(iso, Return));
+
+					protocol.iterableTemplate.Reset(iso, iterable);
+					protocol.iteratorTemplate.Reset(iso, iterator);
+					protocol.iterateTemplate.Reset(iso, v8::FunctionTemplate::New(iso, Iterate));
+					protocol.selfTemplate.Reset(iso, v8::FunctionTemplate::New(iso, Self));
+				}
+
+				return protocol;
+			}
+
+			static void SetIteratorMethod(v8::Isolate* iso, v8::Handle<v8::Object> obj, v8::Handle<v8::FunctionTemplate> method)
+			{
+				v8::Local<v8::Context> context = iso->GetCurrentContext();
+				v8::Local<v8::Value> symbol = context->Global()->Get(v8::String::NewFromUtf8(iso, "Symbol"));
+
+				if (!symbol->IsObject())
+					return;
+
+				v8::Local<v8::Value> key = symbol.As<v8::Object>()->Get(v8::String::NewFromUtf8(iso, "iterator"));
+
+				if (!key->IsUndefined())
+					obj->Set(key, method->GetFunction());
+			}
+
+			/** iterable[Symbol.iterator](), a fresh pass over the range every time. */
+			static void Iterate(const v8::FunctionCallbackInfo<v8::Value>& args)
+			{
+				v8::Isolate* iso = args.GetIsolate();
+				IterableCell<RangeFactory>* iterable = IterableCell<RangeFactory>::From(args.This());
+
+				if (iterable == nullptr)
+				{
+					iso->ThrowException(v8::Exception::TypeError(v8::String::NewFromUtf8(iso, "Not a native iterable")));
+					return;
+				}
+
+				IterationProtocol& protocol = ForIsolate(iso);
+				v8::Local<v8::Object> obj = v8::Local<v8::ObjectTemplate>::New(iso, protocol.iteratorTemplate)->NewInstance();
+
+				IterableCell<IteratorState>* cell = new IterableCell<IteratorState>;
+				cell->payload.source.reset(iterable->payload());
+				cell->chunk = iterable->chunk;
+				cell->handle.Reset(iso, obj);
+				cell->handle.SetWeak(cell, IterableCell<IteratorState>::Free);
+
+				obj->SetAlignedPointerInInternalField(0, cell);
+				SetIteratorMethod(iso, obj, v8::Local<v8::FunctionTemplate>::New(iso, protocol.selfTemplate));
+
+				args.GetReturnValue().Set(obj);
+			}
+
+			static void Self(const v8::FunctionCallbackInfo<v8::Value>& args)
+			{
+				args.GetReturnValue().Set(args.This());
+			}
+
+			////////////////////////////////////////////////////////////////////////////////////////////////////
+			/// <summary>
+			/// 	iterator.next(), converts one element, or up to chunk of them into an array so a loop
+			/// 	over a long range crosses into native code once per chunk instead of once per element.
+			/// 	The source is dropped as soon as it runs dry.
+			/// </summary>
+			////////////////////////////////////////////////////////////////////////////////////////////////////
+			static void Next(const v8::FunctionCallbackInfo<v8::Value>& args)
+			{
+				v8::Isolate* iso = args.GetIsolate();
+				IterableCell<IteratorState>* cell = IterableCell<IteratorState>::From(args.This());
+
+				if (cell == nullptr)
+				{
+					iso->ThrowException(v8::Exception::TypeError(v8::String::NewFromUtf8(iso, "Not a native iterator")));
+					return;
+				}
+
+				RangeSource* source = cell->payload.source.get();
+				v8::Handle<v8::Value> value = v8::Undefined(iso);
+				bool done = true;
+
+				if (source != nullptr && cell->chunk == 0)
+				{
+					done = !source->Next(iso, value);
+				}
+				else if (source != nullptr)
+				{
+					v8::Local<v8::Array> batch = v8::Array::New(iso);
+					v8::Handle<v8::Value> element;
+					uint32_t count = 0;
+
+					while (count < cell->chunk && source->Next(iso, element))
+						batch->Set(count++, element);
+
+					if (count < cell->chunk)
+						cell->payload.source.reset();
+
+					done = count == 0;
+					value = done ? v8::Handle<v8::Value>(v8::Undefined(iso)) : v8::Handle<v8::Value>(batch);
+				}
+
+				if (done)
+					cell->payload.source.reset();
+
+				args.GetReturnValue().Set(Result(iso, value, done));
+			}
+
+			/** iterator.return(), what a break out of for-of calls, lets go of the range early. */
+			static void Return(const v8::FunctionCallbackInfo<v8::Value>& args)
+			{
+				v8::Isolate* iso = args.GetIsolate();
+				IterableCell<IteratorState>* cell = IterableCell<IteratorState>::From(args.This());
+
+				if (cell != nullptr)
+					cell->payload.source.reset();
+
+				args.GetReturnValue().Set(Result(iso, args.Length() > 0 ? args[0] : v8::Handle<v8::Value>(v8::Undefined(iso)), true));
+			}
+
+			static v8::Local<v8::Object> Result(v8::Isolate* iso, v8::Handle<v8::Value> value, bool done)
+			{
+				v8::Local<v8::Object> result = v8::Object::New(iso);
+				result->Set(v8::String::NewFromUtf8(iso, "value"), value);
+				result->Set(v8::String::NewFromUtf8(iso, "done"), v8::Boolean::New(iso, done));
+
+				return result;
+			}
+		};
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	/// <summary>
+	/// 	A native range handed to javascript as a lazy iterable instead of an array, elements are
+	/// 	converted with ShiftJS only as the script asks for them, so breaking out early or scanning
+	/// 	a prefix of a large result never pays for the rest. Return one from any function gear:
+	/// 	
+	/// 	JSIterable Rows(int limit)
+	/// 	{
+	/// 		int next = 0;
+	/// 		return JSIterable::Generate<int>([limit, next](int& out) mutable { out = next++; return out < limit; });
+	/// 	}
+	/// 	...
+	/// 	for (var row of rows(5000000)) { if (row > 10) break; }
+	/// 	
+	/// 	Chunked(K) trades single elements for arrays of up to K of them per next(), for scripts that
+	/// 	walk the whole range and would rather cross into native code less often.
+	/// </summary>
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	class JSIterable
+	{
+	public:
+		JSIterable() : chunk(0) {}
+
+		/** Iterates [begin, end), which has to stay valid for as long as the script iterates it. */
+		template <typename Iterator>
+		static JSIterable Range(Iterator begin, Iterator end)
+		{
+			return JSIterable([begin, end]() -> Internal::RangeSource* {
+				return new Internal::IteratorRangeSource<Iterator>(begin, end, nullptr);
+			});
+		}
+
+		/** Iterates a container it shares ownership of, so it lives until the last iterator is gone. */
+		template <typename Container>
+		static JSIterable Of(std::shared_ptr<Container> container)
+		{
+			return JSIterable([container]() -> Internal::RangeSource* {
+				return new Internal::IteratorRangeSource<typename Container::const_iterator>(container->cbegin(), container->cend(), container);
+			});
+		}
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		/// <summary>
+		/// 	Iterates whatever a generator produces, a callable bool(T&) that fills in the next element
+		/// 	and returns false once there are no more. Every pass starts from a copy of the generator.
+		/// </summary>
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		template <typename T, typename Generator>
+		static JSIterable Generate(Generator generator)
+		{
+			return JSIterable([generator]() -> Internal::RangeSource* {
+				return new Internal::GeneratorRangeSource<T, Generator>(generator);
+			});
+		}
+
+		/** Hands out arrays of up to size elements per next() instead of single elements. */
+		JSIterable& Chunked(size_t size)
+		{
+			chunk = size;
+			return *this;
+		}
+
+		v8::Local<v8::Object> ToJS(v8::Isolate* iso) const
+		{
+			return Internal::IterationProtocol::NewIterable(iso, factory, chunk);
+		}
+
+	private:
+		explicit JSIterable(Internal::RangeFactory factory) : factory(std::move(factory)), chunk(0) {}
+
+		template <typename ThisClass, typename Container, Container ThisClass::*Member, size_t Chunk>
+		friend struct MemberRangeGear;
+
+		Internal::RangeFactory	factory;
+		size_t					chunk;
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	/// <summary>
+	/// 	Binds a container member of a ClassGear type as a lazy iterable, where MemberVariableGear
+	/// 	would convert and copy the whole container on every access. The iterable keeps the wrapper
+	/// 	alive while it is iterated, the container must not be resized meanwhile.
+	/// </summary>
+	///
+	/// <typeparam name="ThisClass">	The class the member belongs to. </typeparam>
+	/// <typeparam name="Container">	Type of the container. </typeparam>
+	/// <typeparam name="Member">   	The member. </typeparam>
+	/// <typeparam name="Chunk">		Elements per next(), 0 for one at a time. </typeparam>
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	template <typename ThisClass, typename Container, Container ThisClass::*Member, size_t Chunk = 0>
+	struct MemberRangeGear
+	{
+		typedef ClassGear<ThisClass> CG;
+
+		static void Getter(v8::Local<v8::String> property, const v8::PropertyCallbackInfo<v8::Value>& info)
+		{
+			v8::Isolate* iso = info.GetIsolate();
+			ThisClass* var = CG::UnwrapUnchecked(iso, info.This());
+
+			if (var == nullptr)
+			{
+				CG::ThrowReleased(iso);
+				return;
+			}
+
+			std::shared_ptr<Internal::RangeOwner> owner = std::make_shared<Internal::RangeOwner>();
+			owner->handle.Reset(iso, info.This());
+
+			Container* container = &(var->*Member);
+
+			JSIterable iterable([container, owner]() -> Internal::RangeSource* {
+				return new Internal::IteratorRangeSource<typename Container::const_iterator>(container->cbegin(), container->cend(), owner);
+			});
+
+			info.GetReturnValue().Set(iterable.Chunked(Chunk).ToJS(iso));
+		}
+
+		static void Bind(v8::Isolate* iso, const char* name)
+		{
+			v8::Local<v8::ObjectTemplate> protoTmpl = CG::PrototypeTemplate(iso);
+			protoTmpl->SetAccessor(v8::String::NewFromUtf8(iso, name), Getter, nullptr, v8::Handle<v8::Value>(), v8::DEFAULT, v8::None, CG::ReceiverAccessorSignature(iso));
+		}
+	};
+
+	namespace TypeConversion
+	{
+		template <>
+		struct ShiftJS<JSIterable>
+		{
+			ValueHandle operator()(v8::Isolate* iso, const JSIterable& v) const
+			{
+				return v.ToJS(iso);
+			}
+		};
+	}
+}
@@ -0,0 +1,938 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+///	The MIT License (MIT)
+///
+///	Copyright (c) 2014 Gregory Hlavac
+///
+///	Permission is hereby granted, free of charge, to any person obtaining a copy
+///	of this software and associated documentation files (the "Software"), to deal
+///	in the Software without restriction, including without limitation the rights
+///	to use, copy, modify, merge, publish, distribute, sub-license, and/or sell
+///	copies of the Software, and to permit persons to whom the Software is
+///	furnished to do so, subject to the following conditions:
+///
+///	The above copyright notice and this permission notice shall be included in
+///	all copies or substantial portions of the Software.
+///
+///	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+///	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+///	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+///	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+///	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+///	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+///	THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <v8.h>
+
+#include <map>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+#include <ctype.h>
+#include <stdio.h>
+#include <locale.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <type_traits>
+
+#include "Common.h"
+#include "TypeConversion.h"
+#include "NativeShifts.h"
+#include "ReflectedStructs.h"
+
+namespace V8Transmission
+{
+	namespace Internal
+	{
+		/** The decimal point snprintf and strtod use under the current C locale, "," in some. */
+		inline const char* DecimalPoint()
+		{
+			const char* point = localeconv()->decimal_point;
+
+			return point != nullptr && *point != '\0' ? point : ".";
+		}
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	/// <summary>
+	/// 	Writes JSON straight into a growable buffer, used by JsonShift<T>::Write.
+	/// 	
+	/// 	Separators are tracked by the writer so shifts only ever call Begin/Key/End and the value
+	/// 	functions in document order.
+	/// </summary>
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	class JsonWriter
+	{
+	public:
+		explicit JsonWriter(size_t reserve = 256) : needsComma(false)
+		{
+			buffer.reserve(reserve);
+		}
+
+		void Null()						{ Separate(); buffer.append("null", 4); }
+		void Bool(bool v)				{ Separate(); v ? buffer.append("true", 4) : buffer.append("false", 5); }
+
+		void Integer(int64_t v)
+		{
+			Separate();
+
+			char digits[24];
+			char* end = digits + sizeof(digits);
+			char* p = end;
+
+			uint64_t magnitude = v < 0 ? 0 - static_cast<uint64_t>(v) : static_cast<uint64_t>(v);
+
+			do
+			{
+				*--p = static_cast<char>('0' + magnitude % 10);
+				magnitude /= 10;
+			} while (magnitude != 0);
+
+			if (v < 0)
+				*--p = '-';
+
+			buffer.append(p, end - p);
+		}
+
+		void Unsigned(uint64_t v)
+		{
+			Separate();
+
+			char digits[24];
+			char* end = digits + sizeof(digits);
+			char* p = end;
+
+			do
+			{
+				*--p = static_cast<char>('0' + v % 10);
+				v /= 10;
+			} while (v != 0);
+
+			buffer.append(p, end - p);
+		}
+
+		void Number(double v)
+		{
+			// JSON has no NaN or Infinity, JSON.stringify writes those as null too.
+			if (v != v || v - v != 0)
+			{
+				Null();
+				return;
+			}
+
+			Separate();
+
+			// The shortest of 15, 16 or 17 digits that reads back as the same double, so 0.1 stays
+			// 0.1 the way JSON.stringify writes it.
+			char digits[32];
+			int length = 0;
+
+			for (int precision = 15; precision <= 17; precision++)
+			{
+				length = snprintf(digits, sizeof(digits), "%.*g", precision, v);
+
+				if (strtod(digits, nullptr) == v)
+					break;
+			}
+
+			// Both of the above follow the C locale, JSON always has a '.'.
+			std::string text(digits, length);
+			const char* point = Internal::DecimalPoint();
+			size_t at = text.find(point);
+
+			if (at != std::string::npos)
+				text.replace(at, strlen(point), ".");
+
+			buffer.append(text);
+		}
+
+		void String(const char* str, size_t length)
+		{
+			static const char hex[] = "0123456789abcdef";
+
+			Separate();
+			buffer.push_back('"');
+
+			size_t run = 0;
+
+			for (size_t i = 0; i < length; i++)
+			{
+				unsigned char c = static_cast<unsigned char>(str[i]);
+
+				if (c >= 0x20 && c != '"' && c != '\\')
+					continue;
+
+				buffer.append(str + run, i - run);
+				run = i + 1;
+
+				switch (c)
+				{
+				case '"':	buffer.append("\\\"", 2); break;
+				case '\\':	buffer.append("\\\\", 2); break;
+				case '\b':	buffer.append("\\b", 2); break;
+				case '\f':	buffer.append("\\f", 2); break;
+				case '\n':	buffer.append("\\n", 2); break;
+				case '\r':	buffer.append("\\r", 2); break;
+				case '\t':	buffer.append("\\t", 2); break;
+				default:
+					{
+						char escape[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF] };
+						buffer.append(escape, 6);
+					}
+				}
+			}
+
+			buffer.append(str + run, length - run);
+			buffer.push_back('"');
+		}
+
+		void String(const std::string& str)	{ String(str.data(), str.size()); }
+
+		void BeginObject()				{ Separate(); buffer.push_back('{'); needsComma = false; }
+		void EndObject()				{ buffer.push_back('}'); needsComma = true; }
+		void BeginArray()				{ Separate(); buffer.push_back('['); needsComma = false; }
+		void EndArray()					{ buffer.push_back(']'); needsComma = true; }
+
+		void Key(const char* name)
+		{
+			String(name, strlen(name));
+			buffer.push_back(':');
+			needsComma = false;
+		}
+
+		std::string& Buffer()			{ return buffer; }
+
+	private:
+		void Separate()
+		{
+			if (needsComma)
+				buffer.push_back(',');
+
+			needsComma = true;
+		}
+
+		std::string	buffer;
+		bool		needsComma;
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	/// <summary>
+	/// 	A forward only JSON reader over a UTF-8 buffer, used by JsonShift<T>::Read.
+	/// 	
+	/// 	Any syntax error or type mismatch puts the reader into a failed state, after which every call
+	/// 	returns false, so shifts don't need to check each step. So does nesting deeper than
+	/// 	MaxDepth, reading recurses once per level and input from a peer mustn't be able to run the
+	/// 	stack out.
+	/// </summary>
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	class JsonReader
+	{
+	public:
+		static const int MaxDepth = 512;
+
+		JsonReader(const char* data, size_t length) : cursor(data), end(data + length), depth(0), failed(false) {}
+
+		bool Failed() const				{ return failed; }
+
+		/** True if the next value is null, which is consumed. */
+		bool TryNull()
+		{
+			SkipWhitespace();
+
+			if (end - cursor >= 4 && memcmp(cursor, "null", 4) == 0)
+			{
+				cursor += 4;
+				return true;
+			}
+
+			return false;
+		}
+
+		bool Bool(bool& v)
+		{
+			SkipWhitespace();
+
+			if (end - cursor >= 4 && memcmp(cursor, "true", 4) == 0)
+			{
+				cursor += 4;
+				v = true;
+				return true;
+			}
+
+			if (end - cursor >= 5 && memcmp(cursor, "false", 5) == 0)
+			{
+				cursor += 5;
+				v = false;
+				return true;
+			}
+
+			return Fail();
+		}
+
+		bool Number(double& v)
+		{
+			SkipWhitespace();
+
+			const char* start = cursor;
+
+			if (cursor < end && (*cursor == '-' || *cursor == '+'))
+				cursor++;
+
+			while (cursor < end && (isdigit(static_cast<unsigned char>(*cursor)) || *cursor == '.' || *cursor == 'e' || *cursor == 'E' || *cursor == '-' || *cursor == '+'))
+				cursor++;
+
+			if (cursor == start)
+				return Fail();
+
+			std::string digits(start, cursor);
+
+			// strtod follows the C locale, which may want something else than JSON's '.'.
+			const char* point = Internal::DecimalPoint();
+			size_t at = digits.find('.');
+
+			if (at != std::string::npos && strcmp(point, ".") != 0)
+				digits.replace(at, 1, point);
+
+			char* parsed_end = nullptr;
+			v = strtod(digits.c_str(), &parsed_end);
+
+			return parsed_end == digits.c_str() + digits.size() ? true : Fail();
+		}
+
+		/** Reads a number whose integer part lies in [low, high), anything else is a type mismatch. */
+		bool Integer(double& v, double low, double high)
+		{
+			if (!Number(v))
+				return false;
+
+			v = std::trunc(v);
+
+			return v >= low && v < high ? true : Fail();
+		}
+
+		bool String(std::string& v)
+		{
+			SkipWhitespace();
+
+			if (cursor >= end || *cursor != '"')
+				return Fail();
+
+			cursor++;
+			v.clear();
+
+			const char* run = cursor;
+
+			while (cursor < end && *cursor != '"')
+			{
+				if (*cursor != '\\')
+				{
+					cursor++;
+					continue;
+				}
+
+				v.append(run, cursor - run);
+
+				if (++cursor >= end)
+					return Fail();
+
+				switch (*cursor++)
+				{
+				case '"':	v.push_back('"'); break;
+				case '\\':	v.push_back('\\'); break;
+				case '/':	v.push_back('/'); break;
+				case 'b':	v.push_back('\b'); break;
+				case 'f':	v.push_back('\f'); break;
+				case 'n':	v.push_back('\n'); break;
+				case 'r':	v.push_back('\r'); break;
+				case 't':	v.push_back('\t'); break;
+				case 'u':
+					{
+						uint32_t code;
+
+						if (!Hex4(code))
+							return false;
+
+						// A high surrogate has to be followed by its low half.
+						if (code >= 0xD800 && code <= 0xDBFF)
+						{
+							uint32_t low;
+
+							if (end - cursor < 2 || cursor[0] != '\\' || cursor[1] != 'u')
+								return Fail();
+
+							cursor += 2;
+
+							if (!Hex4(low) || low < 0xDC00 || low > 0xDFFF)
+								return Fail();
+
+							code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+						}
+
+						AppendUtf8(v, code);
+						break;
+					}
+				default:
+					return Fail();
+				}
+
+				run = cursor;
+			}
+
+			if (cursor >= end)
+				return Fail();
+
+			v.append(run, cursor - run);
+			cursor++;
+
+			return true;
+		}
+
+		bool BeginObject()				{ return Enter('{'); }
+		bool BeginArray()				{ return Enter('['); }
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		/// <summary>
+		/// 	Moves to the next key of the object opened with BeginObject, false once the closing brace
+		/// 	has been consumed (or on error).
+		/// </summary>
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		bool NextKey(std::string& key, bool first)
+		{
+			if (!NextItem('}', first))
+				return false;
+
+			return String(key) && Expect(':');
+		}
+
+		/** Moves to the next element of the array opened with BeginArray, false once it has been closed. */
+		bool NextElement(bool first)
+		{
+			return NextItem(']', first);
+		}
+
+		/** Skips over one value of any type, used for keys a struct doesn't have. */
+		bool Skip()
+		{
+			SkipWhitespace();
+
+			if (cursor >= end)
+				return Fail();
+
+			std::string scratch;
+			double number;
+			bool boolean;
+
+			switch (*cursor)
+			{
+			case '"':	return String(scratch);
+			case 't':
+			case 'f':	return Bool(boolean);
+			case 'n':	return TryNull() ? true : Fail();
+			case '{':
+				{
+					BeginObject();
+
+					for (bool first = true; NextKey(scratch, first); first = false)
+					{
+						if (!Skip())
+							return false;
+					}
+
+					return !failed;
+				}
+			case '[':
+				{
+					BeginArray();
+
+					for (bool first = true; NextElement(first); first = false)
+					{
+						if (!Skip())
+							return false;
+					}
+
+					return !failed;
+				}
+			default:	return Number(number);
+			}
+		}
+
+		/** True if nothing but whitespace is left. */
+		bool AtEnd()
+		{
+			SkipWhitespace();
+			return cursor == end;
+		}
+
+	private:
+		void SkipWhitespace()
+		{
+			while (cursor < end && (*cursor == ' ' || *cursor == '\t' || *cursor == '\n' || *cursor == '\r'))
+				cursor++;
+		}
+
+		bool Fail()
+		{
+			failed = true;
+			cursor = end;
+			return false;
+		}
+
+		bool Expect(char c)
+		{
+			SkipWhitespace();
+
+			if (failed || cursor >= end || *cursor != c)
+				return Fail();
+
+			cursor++;
+			return true;
+		}
+
+		bool Enter(char open)
+		{
+			if (!Expect(open))
+				return false;
+
+			return ++depth <= MaxDepth ? true : Fail();
+		}
+
+		bool NextItem(char close, bool first)
+		{
+			if (failed)
+				return false;
+
+			SkipWhitespace();
+
+			if (cursor < end && *cursor == close)
+			{
+				cursor++;
+				depth--;
+				return false;
+			}
+
+			if (!first && !Expect(','))
+				return false;
+
+			return true;
+		}
+
+		bool Hex4(uint32_t& code)
+		{
+			if (end - cursor < 4)
+				return Fail();
+
+			code = 0;
+
+			for (int i = 0; i < 4; i++)
+			{
+				char c = *cursor++;
+				code <<= 4;
+
+				if (c >= '0' && c <= '9')		code |= c - '0';
+				else if (c >= 'a' && c <= 'f')	code |= c - 'a' + 10;
+				else if (c >= 'A' && c <= 'F')	code |= c - 'A' + 10;
+				else							return Fail();
+			}
+
+			return true;
+		}
+
+		static void AppendUtf8(std::string& str, uint32_t code)
+		{
+			if (code < 0x80)
+			{
+				str.push_back(static_cast<char>(code));
+			}
+			else if (code < 0x800)
+			{
+				str.push_back(static_cast<char>(0xC0 | (code >> 6)));
+				str.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+			}
+			else if (code < 0x10000)
+			{
+				str.push_back(static_cast<char>(0xE0 | (code >> 12)));
+				str.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+				str.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+			}
+			else
+			{
+				str.push_back(static_cast<char>(0xF0 | (code >> 18)));
+				str.push_back(static_cast<char>(0x80 | ((code >> 12) & 0x3F)));
+				str.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+				str.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+			}
+		}
+
+		const char*	cursor;
+		const char*	end;
+		int			depth;
+		bool		failed;
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	/// <summary>
+	/// 	Writes and reads one native type as JSON, the JSON counterpart of ShiftJS/ShiftNative.
+	/// 	
+	/// 	Arithmetic types, bool, std::string, std::vector, std::map with string keys, smart and raw
+	/// 	pointers (null or the pointee) and anything with StructFields<T> (V8T_REFLECT_STRUCT or, for
+	/// 	ClassGear bound types, V8T_DESCRIBE_FIELDS) are covered, specialize it for anything else.
+	/// </summary>
+	///
+	/// <typeparam name="T">	Generic type parameter. </typeparam>
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	template <typename T, typename Enable = void>
+	struct JsonShift
+	{
+		static void Write(JsonWriter& writer, const T& v)
+		{
+			FieldWriter fields = { &writer, &v };
+
+			writer.BeginObject();
+			StructFields<T>::Visit(fields);
+			writer.EndObject();
+		}
+
+		static bool Read(JsonReader& reader, T& v)
+		{
+			if (!reader.BeginObject())
+				return false;
+
+			std::string key;
+
+			for (bool first = true; reader.NextKey(key, first); first = false)
+			{
+				FieldReader fields = { &reader, &v, &key, false };
+				StructFields<T>::Visit(fields);
+
+				if (!fields.matched && !reader.Skip())
+					return false;
+			}
+
+			return !reader.Failed();
+		}
+
+	private:
+		struct FieldWriter
+		{
+			JsonWriter*	writer;
+			const T*	src;
+
+			template <typename M>
+			void operator()(const char* name, M T::* member)
+			{
+				writer->Key(name);
+				JsonShift<M>::Write(*writer, src->*member);
+			}
+		};
+
+		struct FieldReader
+		{
+			JsonReader*			reader;
+			T*					dst;
+			const std::string*	key;
+			bool				matched;
+
+			template <typename M>
+			void operator()(const char* name, M T::* member)
+			{
+				if (!matched && *key == name)
+				{
+					matched = true;
+					JsonShift<M>::Read(*reader, dst->*member);
+				}
+			}
+		};
+	};
+
+	template <>
+	struct JsonShift<bool>
+	{
+		static void Write(JsonWriter& writer, bool v)	{ writer.Bool(v); }
+		static bool Read(JsonReader& reader, bool& v)	{ return reader.Bool(v); }
+	};
+
+	template <typename T>
+	struct JsonShift<T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value>::type>
+	{
+		static void Write(JsonWriter& writer, T v)
+		{
+			if (std::is_signed<T>::value)
+				writer.Integer(static_cast<int64_t>(v));
+			else
+				writer.Unsigned(static_cast<uint64_t>(v));
+		}
+
+		static bool Read(JsonReader& reader, T& v)
+		{
+			// Both bounds are powers of two, so they are exact as doubles.
+			const double high = std::ldexp(1.0, std::numeric_limits<T>::digits);
+			const double low = std::is_signed<T>::value ? -high : 0;
+
+			double number;
+
+			if (!reader.Integer(number, low, high))
+				return false;
+
+			v = static_cast<T>(number);
+			return true;
+		}
+	};
+
+	template <typename T>
+	struct JsonShift<T, typename std::enable_if<std::is_floating_point<T>::value>::type>
+	{
+		static void Write(JsonWriter& writer, T v)		{ writer.Number(static_cast<double>(v)); }
+
+		static bool Read(JsonReader& reader, T& v)
+		{
+			double number;
+
+			if (reader.TryNull())
+			{
+				v = static_cast<T>(NAN);
+				return true;
+			}
+
+			if (!reader.Number(number))
+				return false;
+
+			v = static_cast<T>(number);
+			return true;
+		}
+	};
+
+	template <>
+	struct JsonShift<std::string>
+	{
+		static void Write(JsonWriter& writer, const std::string& v)	{ writer.String(v); }
+		static bool Read(JsonReader& reader, std::string& v)		{ return reader.String(v); }
+	};
+
+	template <typename T>
+	struct JsonShift<std::vector<T> >
+	{
+		static void Write(JsonWriter& writer, const std::vector<T>& v)
+		{
+			writer.BeginArray();
+
+			for (size_t i = 0; i < v.size(); i++)
+				JsonShift<T>::Write(writer, v[i]);
+
+			writer.EndArray();
+		}
+
+		static bool Read(JsonReader& reader, std::vector<T>& v)
+		{
+			v.clear();
+
+			if (!reader.BeginArray())
+				return false;
+
+			for (bool first = true; reader.NextElement(first); first = false)
+			{
+				v.push_back(T());
+
+				if (!JsonShift<T>::Read(reader, v.back()))
+					return false;
+			}
+
+			return !reader.Failed();
+		}
+	};
+
+	template <typename T>
+	struct JsonShift<std::map<std::string, T> >
+	{
+		static void Write(JsonWriter& writer, const std::map<std::string, T>& v)
+		{
+			writer.BeginObject();
+
+			for (typename std::map<std::string, T>::const_iterator it = v.begin(); it != v.end(); ++it)
+			{
+				writer.Key(it->first.c_str());
+				JsonShift<T>::Write(writer, it->second);
+			}
+
+			writer.EndObject();
+		}
+
+		static bool Read(JsonReader& reader, std::map<std::string, T>& v)
+		{
+			v.clear();
+
+			if (!reader.BeginObject())
+				return false;
+
+			std::string key;
+
+			for (bool first = true; reader.NextKey(key, first); first = false)
+			{
+				if (!JsonShift<T>::Read(reader, v[key]))
+					return false;
+			}
+
+			return !reader.Failed();
+		}
+	};
+
+	namespace Internal
+	{
+		/** Pointers are written as their pointee or null, reading allocates through Make. */
+		template <typename Pointer, typename T>
+		struct JsonShift_Pointer
+		{
+			static void Write(JsonWriter& writer, const Pointer& v)
+			{
+				if (v)
+					JsonShift<T>::Write(writer, *v);
+				else
+					writer.Null();
+			}
+		};
+	}
+
+	template <typename T>
+	struct JsonShift<T*> : Internal::JsonShift_Pointer<T*, T>
+	{
+		static bool Read(JsonReader& reader, T*& v)
+		{
+			if (reader.TryNull())
+			{
+				v = nullptr;
+				return true;
+			}
+
+			std::unique_ptr<T> owned(new T());
+
+			if (!JsonShift<T>::Read(reader, *owned))
+				return false;
+
+			v = owned.release();
+			return true;
+		}
+	};
+
+	template <typename T>
+	struct JsonShift<std::unique_ptr<T> > : Internal::JsonShift_Pointer<std::unique_ptr<T>, T>
+	{
+		static bool Read(JsonReader& reader, std::unique_ptr<T>& v)
+		{
+			v.reset();
+
+			if (reader.TryNull())
+				return true;
+
+			v.reset(new T());
+			return JsonShift<T>::Read(reader, *v);
+		}
+	};
+
+	template <typename T>
+	struct JsonShift<std::shared_ptr<T> > : Internal::JsonShift_Pointer<std::shared_ptr<T>, T>
+	{
+		static bool Read(JsonReader& reader, std::shared_ptr<T>& v)
+		{
+			v.reset();
+
+			if (reader.TryNull())
+				return true;
+
+			v = std::make_shared<T>();
+			return JsonShift<T>::Read(reader, *v);
+		}
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	/// <summary>
+	/// 	Writes a native value as JSON without building any JS objects, the text comes back as one JS
+	/// 	string. Large ASCII documents are moved into V8 as an external string (see ShiftJS<std::string>)
+	/// 	rather than copied.
+	/// </summary>
+	///
+	/// <param name="iso">	[in,out] If non-null, the ISO. </param>
+	/// <param name="v">  	The value to write. </param>
+	///
+	/// <returns>
+	/// 	The JSON text, equivalent to JSON.stringify of the converted value.
+	/// </returns>
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	template <typename T>
+	v8::Handle<v8::Value> ConvertToJSON(v8::Isolate* iso, const T& v)
+	{
+		JsonWriter writer;
+		JsonShift<T>::Write(writer, v);
+
+		return TypeConversion::ShiftJS<std::string>()(iso, std::move(writer.Buffer()));
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	/// <summary>
+	/// 	Parses JSON text handed over from javascript straight into a native value, skipping the
+	/// 	JSON.parse object graph. Returns false if the text didn't fit T.
+	/// </summary>
+	///
+	/// <param name="iso">	[in,out] If non-null, the ISO. </param>
+	/// <param name="json">	The JSON text. </param>
+	/// <param name="out">	[out] The parsed value. </param>
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	template <typename T>
+	bool ConvertFromJSON(v8::Isolate* iso, v8::Handle<v8::Value> json, T& out)
+	{
+		v8::String::Utf8Value utf8(json);
+
+		if (*utf8 == nullptr)
+			return false;
+
+		JsonReader reader(*utf8, utf8.length());
+
+		return JsonShift<T>::Read(reader, out) && reader.AtEnd();
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	/// <summary>
+	/// 	A value that crosses the gear boundary as JSON text instead of as a JS object.
+	/// 	
+	/// 	Return JsonText<T> from a bound function and javascript receives the JSON string, take it as
+	/// 	a parameter and a JSON string argument is parsed natively into it.
+	/// </summary>
+	///
+	/// <typeparam name="T">	The carried type. </typeparam>
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	template <typename T>
+	struct JsonText
+	{
+		T	value;
+		bool valid;
+
+		JsonText() : value(), valid(false) {}
+		JsonText(T v) : value(std::move(v)), valid(true) {}
+	};
+
+	namespace TypeConversion
+	{
+		template <typename T>
+		struct ShiftJS<JsonText<T> >
+		{
+			ValueHandle operator()(v8::Isolate* iso, const JsonText<T>& v) const
+			{
+				return ConvertToJSON(iso, v.value);
+			}
+		};
+
+		template <typename T>
+		struct ShiftNative<JsonText<T> >
+		{
+			JsonText<T> operator()(v8::Isolate* iso, const v8::Handle<v8::Value>& val) const
+			{
+				JsonText<T> result;
+				result.valid = ConvertFromJSON(iso, val, result.value);
+
+				return result;
+			}
+		};
+	}
+}
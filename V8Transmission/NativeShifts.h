@@ -80,9 +80,26 @@ namespace V8Transmission
 		template <>
 		struct ShiftJS<std::string>
 		{
-			ValueHandle operator()(v8::Isolate* iso, std::string v) const
+			/** Strings at least this long that are handed over as rvalues are moved into V8 instead of copied. */
+			static const size_t ExternalizeThreshold = 4096;
+
+			ValueHandle operator()(v8::Isolate* iso, const std::string& v) const
+			{
+				return v8::String::NewFromUtf8(iso, v.c_str(), v8::String::kNormalString, static_cast<int>(v.size()));
+			}
+
+			////////////////////////////////////////////////////////////////////////////////////////////////////
+			/// <summary>
+			/// 	A string nobody else holds on to anymore, if it is large and plain ASCII its buffer is moved
+			/// 	into an external string resource that V8 frees on GC, otherwise it is copied like above.
+			/// </summary>
+			////////////////////////////////////////////////////////////////////////////////////////////////////
+			ValueHandle operator()(v8::Isolate* iso, std::string&& v) const
 			{
-				return v8::String::NewFromUtf8(iso, v.c_str(), v8::String::kNormalString, v.size());
+				if (v.size() < ExternalizeThreshold || !Internal::IsAscii(v))
+					return (*this)(iso, static_cast<const std::string&>(v));
+
+				return v8::String::NewExternal(iso, new Internal::MovedAsciiStringResource(std::move(v)));
 			}
 		};
 #pragma endregion
@@ -103,12 +120,55 @@ namespace V8Transmission
 
 
 #pragma region Shift to Native Type
+		template <> struct ShiftNative<unsigned char> : Internal::ShiftNative_Unsigned_Integer_Small<unsigned char>{};
+
+		template <> struct ShiftNative<int16_t> : Internal::ShiftNative_Integer_Small<int16_t>{};
+
+		template <> struct ShiftNative<uint16_t> : Internal::ShiftNative_Unsigned_Integer_Small<uint16_t>{};
+
+		template <> struct ShiftNative<int32_t> : Internal::ShiftNative_Integer_Small<int32_t>{};
+
+		template <> struct ShiftNative<uint32_t> : Internal::ShiftNative_Unsigned_Integer_Small<uint32_t>{};
+
+		template <> struct ShiftNative<int64_t> : Internal::ShiftNative_Integer_Large<int64_t> {};
+
+		template <> struct ShiftNative<uint64_t> : Internal::ShiftNative_Integer_Large<uint64_t> {};
+
+		template <>
+		struct ShiftNative<float>
+		{
+			float operator()(v8::Isolate* iso, const v8::Handle<v8::Value>& val) const
+			{
+				return static_cast<float>(val->NumberValue());
+			}
+		};
+
+		template <>
+		struct ShiftNative<double>
+		{
+			double operator()(v8::Isolate* iso, const v8::Handle<v8::Value>& val) const
+			{
+				return val->NumberValue();
+			}
+		};
+
+		template <>
+		struct ShiftNative<bool>
+		{
+			bool operator()(v8::Isolate* iso, const v8::Handle<v8::Value>& val) const
+			{
+				return val->BooleanValue();
+			}
+		};
+
 		template<>
 		struct ShiftNative<std::string>
 		{
 			std::string operator()(v8::Isolate* iso, const v8::Handle<v8::Value>& val) const
 			{
-				return std::string(*v8::String::Utf8Value(val));
+				v8::String::Utf8Value utf8(val);
+
+				return std::string(*utf8, utf8.length());
 			}
 		};
 #pragma endregion Shift to Native Type
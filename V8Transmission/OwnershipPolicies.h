@@ -0,0 +1,138 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+///	The MIT License (MIT)
+///
+///	Copyright (c) 2014 Gregory Hlavac
+///
+///	Permission is hereby granted, free of charge, to any person obtaining a copy
+///	of this software and associated documentation files (the "Software"), to deal
+///	in the Software without restriction, including without limitation the rights
+///	to use, copy, modify, merge, publish, distribute, sub-license, and/or sell
+///	copies of the Software, and to permit persons to whom the Software is
+///	furnished to do so, subject to the following conditions:
+///
+///	The above copyright notice and this permission notice shall be included in
+///	all copies or substantial portions of the Software.
+///
+///	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+///	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+///	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+///	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+///	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+///	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+///	THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <v8.h>
+
+#include <memory>
+
+#include "Common.h"
+
+namespace V8Transmission
+{
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	/// <summary>
+	/// 	A ClassOption describing how to add and drop a reference on an intrusively reference counted
+	/// 	type, used by Ownership::Intrusive. By default it calls AddRef() and Release() on the object.
+	/// </summary>
+	///
+	/// <typeparam name="T">	Generic type parameter. </typeparam>
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	template <typename T>
+	struct CO_IntrusiveRefCount
+	{
+		static void AddRef(T* obj) { obj->AddRef(); }
+		static void Release(T* obj) { obj->Release(); }
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	/// <summary>
+	/// 	Ownership policies for ClassGear<T>::WrapWith.
+	/// 	
+	/// 	Each policy names the Reference the JS wrapper keeps, how to get the raw pointer out of it and
+	/// 	what to do with it once the wrapper has been garbage collected. Policies that retain anything
+	/// 	(Intrusive included) cost one heap allocation per wrapper: a WrapperCell holding the Reference
+	/// 	inline together with the weak handle that releases it, since this V8's weak callbacks need a
+	/// 	Persistent that outlives the call to reset. Borrowed wrappers allocate nothing extra.
+	/// </summary>
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	namespace Ownership
+	{
+		/** The wrapper only borrows the object, native code keeps it alive for at least as long as JS can see it. */
+		template <typename T>
+		struct Borrowed
+		{
+			typedef T* Reference;
+
+			enum { Retains = 0 };
+
+			static T* Get(const Reference& ref) { return ref; }
+			static void Release(Reference& ref) {}
+		};
+
+		/** The wrapper is the only owner, the object is deleted once it has been collected. */
+		template <typename T>
+		struct Unique
+		{
+			typedef std::unique_ptr<T> Reference;
+
+			enum { Retains = 1 };
+
+			static T* Get(const Reference& ref) { return ref.get(); }
+			static void Release(Reference& ref) { ref.reset(); }
+		};
+
+		/** The wrapper holds one std::shared_ptr reference, native subsystems keep sharing the object. */
+		template <typename T>
+		struct Shared
+		{
+			typedef std::shared_ptr<T> Reference;
+
+			enum { Retains = 1 };
+
+			static T* Get(const Reference& ref) { return ref.get(); }
+			static void Release(Reference& ref) { ref.reset(); }
+		};
+
+		/** The wrapper holds one reference on an intrusively counted object, see CO_IntrusiveRefCount<T>. */
+		template <typename T>
+		struct Intrusive
+		{
+			typedef T* Reference;
+
+			enum { Retains = 1 };
+
+			static T* Get(const Reference& ref) { return ref; }
+
+			static Reference Acquire(T* obj)
+			{
+				CO_IntrusiveRefCount<T>::AddRef(obj);
+				return obj;
+			}
+
+			static void Release(Reference& ref)
+			{
+				CO_IntrusiveRefCount<T>::Release(ref);
+				ref = nullptr;
+			}
+		};
+
+		/** The wrapper owns an object made by a ClassGear factory and hands it back to Factory::Destruct. */
+		template <typename T, typename Factory>
+		struct FactoryOwned
+		{
+			typedef T* Reference;
+
+			enum { Retains = 1 };
+
+			static T* Get(const Reference& ref) { return ref; }
+
+			static void Release(Reference& ref)
+			{
+				Factory::Destruct(ref);
+				ref = nullptr;
+			}
+		};
+	}
+}
@@ -0,0 +1,341 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+///	The MIT License (MIT)
+///
+///	Copyright (c) 2014 Gregory Hlavac
+///
+///	Permission is hereby granted, free of charge, to any person obtaining a copy
+///	of this software and associated documentation files (the "Software"), to deal
+///	in the Software without restriction, including without limitation the rights
+///	to use, copy, modify, merge, publish, distribute, sub-license, and/or sell
+///	copies of the Software, and to permit persons to whom the Software is
+///	furnished to do so, subject to the following conditions:
+///
+///	The above copyright notice and this permission notice shall be included in
+///	all copies or substantial portions of the Software.
+///
+///	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+///	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+///	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+///	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+///	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+///	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+///	THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <v8.h>
+#include <v8-profiler.h>
+
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdint.h>
+#include <unordered_map>
+
+#include "Common.h"
+#include "NativeJSON.h"
+
+namespace V8Transmission
+{
+	namespace Internal
+	{
+		/** Display name of a profile frame, gear functions carry the name they were bound under. */
+		inline std::string ProfileFrameName(const v8::CpuProfileNode* node)
+		{
+			v8::String::Utf8Value name(node->GetFunctionName());
+
+			return *name != nullptr && name.length() > 0 ? std::string(*name, name.length()) : std::string("(anonymous)");
+		}
+
+		inline std::string ProfileFrameURL(const v8::CpuProfileNode* node)
+		{
+			v8::String::Utf8Value url(node->GetScriptResourceName());
+
+			return *url != nullptr ? std::string(*url, url.length()) : std::string();
+		}
+
+		/** Self samples per node, counted from the recorded samples rather than trusted from the nodes. */
+		typedef std::unordered_map<const v8::CpuProfileNode*, uint64_t> ProfileHits;
+
+		inline ProfileHits CountProfileHits(const v8::CpuProfile* profile)
+		{
+			ProfileHits hits;
+
+			for (int i = 0; i < profile->GetSamplesCount(); i++)
+				hits[profile->GetSample(i)]++;
+
+			return hits;
+		}
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	/// <summary>
+	/// 	Samples an isolate with V8's CPU profiler and writes what it saw as a .cpuprofile (for the
+	/// 	DevTools/VS Code profile views) and as collapsed stacks (for flamegraph.pl, speedscope and
+	/// 	the like).
+	/// 	
+	/// 	Native frames show up under the name of the JS function that called into them, which the
+	/// 	gears' Bind functions set to the name they bind, so time spent in a gear is attributed to
+	/// 	"greet" rather than to an anonymous function.
+	/// 	
+	/// 	Example
+	/// 	
+	/// 	CpuProfileSession profile(isolate, 500);
+	/// 	profile.Start();
+	/// 	script->Run();
+	/// 	profile.Stop("run.cpuprofile", "run.folded");
+	/// 	
+	/// </summary>
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	class CpuProfileSession
+	{
+	public:
+		/** V8's own default, one sample per millisecond. */
+		static const int DefaultInterval = 1000;
+
+		explicit CpuProfileSession(v8::Isolate* iso, int samplingIntervalUs = DefaultInterval)
+			: iso(iso), interval(samplingIntervalUs > 0 ? samplingIntervalUs : DefaultInterval), running(false)
+		{
+#if V8T_V8_AT_LEAST(5, 4)
+			profiler = v8::CpuProfiler::New(iso);
+#else
+			profiler = iso->GetCpuProfiler();
+#endif
+		}
+
+		~CpuProfileSession()
+		{
+			if (running)
+				Stop(nullptr, nullptr);
+
+#if V8T_V8_AT_LEAST(5, 4)
+			profiler->Dispose();
+#endif
+		}
+
+		CpuProfileSession(const CpuProfileSession&) = delete;
+		CpuProfileSession& operator=(const CpuProfileSession&) = delete;
+
+		/** Starts sampling, the interval can only change while the profiler is idle. */
+		bool Start(const char* title = "V8Transmission")
+		{
+			if (running)
+				return false;
+
+			v8::HandleScope scope(iso);
+
+			this->title = title;
+			profiler->SetSamplingInterval(interval);
+			profiler->StartProfiling(v8::String::NewFromUtf8(iso, title), true);
+			running = true;
+
+			return true;
+		}
+
+		bool Running() const
+		{
+			return running;
+		}
+
+		/** Stops sampling and writes the profile to whichever of the paths isn't null, false if a write failed. */
+		bool Stop(const char* cpuprofilePath, const char* collapsedPath)
+		{
+			if (!running)
+				return false;
+
+			v8::HandleScope scope(iso);
+
+			auto profile = profiler->StopProfiling(v8::String::NewFromUtf8(iso, title.c_str()));
+			running = false;
+
+			if (profile == nullptr)
+				return false;
+
+			bool written = true;
+
+			if (cpuprofilePath != nullptr)
+				written = WriteFile(cpuprofilePath, ToCpuProfileJSON(profile)) && written;
+
+			if (collapsedPath != nullptr)
+				written = WriteFile(collapsedPath, ToCollapsedStacks(profile)) && written;
+
+			const_cast<v8::CpuProfile*>(profile)->Delete();
+
+			return written;
+		}
+
+		/** The DevTools .cpuprofile format: a flat node list, sample node ids and time deltas in microseconds. */
+		static std::string ToCpuProfileJSON(const v8::CpuProfile* profile)
+		{
+			Internal::ProfileHits hits = Internal::CountProfileHits(profile);
+			JsonWriter json(64 * 1024);
+
+			json.BeginObject();
+
+			json.Key("nodes");
+			json.BeginArray();
+			WriteNode(json, profile->GetTopDownRoot(), hits);
+			json.EndArray();
+
+			int64_t start = profile->GetStartTime();
+			int64_t end = profile->GetEndTime();
+			int count = profile->GetSamplesCount();
+
+			json.Key("startTime");
+			json.Integer(start);
+			json.Key("endTime");
+			json.Integer(end);
+
+			json.Key("samples");
+			json.BeginArray();
+			for (int i = 0; i < count; i++)
+				json.Unsigned(profile->GetSample(i)->GetNodeId());
+			json.EndArray();
+
+			json.Key("timeDeltas");
+			json.BeginArray();
+			int64_t last = start;
+			for (int i = 0; i < count; i++)
+			{
+#if V8T_V8_AT_LEAST(4, 0)
+				int64_t at = profile->GetSampleTimestamp(i);
+#else
+				// No per sample timestamps, spread the samples evenly over the run.
+				int64_t at = start + (end - start) * (i + 1) / count;
+#endif
+				json.Integer(at - last);
+				last = at;
+			}
+			json.EndArray();
+
+			json.EndObject();
+
+			return json.Buffer();
+		}
+
+		/** One "root;caller;callee count" line per stack that was on top for at least one sample. */
+		static std::string ToCollapsedStacks(const v8::CpuProfile* profile)
+		{
+			Internal::ProfileHits hits = Internal::CountProfileHits(profile);
+			std::string out;
+			std::string stack;
+
+			const v8::CpuProfileNode* root = profile->GetTopDownRoot();
+
+			for (int i = 0; i < root->GetChildrenCount(); i++)
+				CollapseNode(out, stack, root->GetChild(i), hits);
+
+			return out;
+		}
+
+		/** Where Oil Change puts the collapsed stacks next to a .cpuprofile, "run.cpuprofile" gives "run.folded". */
+		static std::string CollapsedPath(const std::string& cpuprofilePath)
+		{
+			static const std::string extension = ".cpuprofile";
+
+			if (cpuprofilePath.size() > extension.size() && cpuprofilePath.compare(cpuprofilePath.size() - extension.size(), extension.size(), extension) == 0)
+				return cpuprofilePath.substr(0, cpuprofilePath.size() - extension.size()) + ".folded";
+
+			return cpuprofilePath + ".folded";
+		}
+
+	private:
+		v8::Isolate*		iso;
+		v8::CpuProfiler*	profiler;
+		std::string			title;
+		int					interval;
+		bool				running;
+
+		static void WriteNode(JsonWriter& json, const v8::CpuProfileNode* node, const Internal::ProfileHits& hits)
+		{
+			Internal::ProfileHits::const_iterator hit = hits.find(node);
+
+			json.BeginObject();
+			json.Key("id");
+			json.Unsigned(node->GetNodeId());
+
+			json.Key("callFrame");
+			json.BeginObject();
+			json.Key("functionName");
+			// The root and V8's synthetic frames already come named "(root)", "(program)" and so on.
+			v8::String::Utf8Value name(node->GetFunctionName());
+			json.String(*name != nullptr ? std::string(*name, name.length()) : std::string());
+			json.Key("scriptId");
+#if V8T_V8_AT_LEAST(4, 0)
+			json.String(std::to_string(node->GetScriptId()));
+#else
+			json.String("0", 1);
+#endif
+			json.Key("url");
+			json.String(Internal::ProfileFrameURL(node));
+			// V8 counts lines and columns from 1, the format from 0.
+			json.Key("lineNumber");
+			json.Integer(node->GetLineNumber() - 1);
+			json.Key("columnNumber");
+			json.Integer(node->GetColumnNumber() - 1);
+			json.EndObject();
+
+			json.Key("hitCount");
+			json.Unsigned(hit != hits.end() ? hit->second : 0);
+
+			json.Key("children");
+			json.BeginArray();
+			for (int i = 0; i < node->GetChildrenCount(); i++)
+				json.Unsigned(node->GetChild(i)->GetNodeId());
+			json.EndArray();
+
+			json.EndObject();
+
+			for (int i = 0; i < node->GetChildrenCount(); i++)
+				WriteNode(json, node->GetChild(i), hits);
+		}
+
+		static void CollapseNode(std::string& out, std::string& stack, const v8::CpuProfileNode* node, const Internal::ProfileHits& hits)
+		{
+			size_t mark = stack.size();
+
+			if (!stack.empty())
+				stack.push_back(';');
+
+			std::string frame = Internal::ProfileFrameName(node);
+			std::string url = Internal::ProfileFrameURL(node);
+
+			if (!url.empty())
+				frame += " (" + url + ":" + std::to_string(node->GetLineNumber()) + ")";
+
+			// Semicolons separate frames and the count follows the last space, neither may be ambiguous.
+			for (size_t i = 0; i < frame.size(); i++)
+				if (frame[i] == ';' || frame[i] == '\n')
+					frame[i] = ',';
+
+			stack += frame;
+
+			Internal::ProfileHits::const_iterator hit = hits.find(node);
+
+			if (hit != hits.end() && hit->second > 0)
+			{
+				out += stack;
+				out.push_back(' ');
+				out += std::to_string(hit->second);
+				out.push_back('\n');
+			}
+
+			for (int i = 0; i < node->GetChildrenCount(); i++)
+				CollapseNode(out, stack, node->GetChild(i), hits);
+
+			stack.resize(mark);
+		}
+
+		static bool WriteFile(const char* path, const std::string& contents)
+		{
+			FILE* file = fopen(path, "wb");
+
+			if (file == nullptr)
+				return false;
+
+			bool written = fwrite(contents.data(), 1, contents.size(), file) == contents.size();
+
+			return fclose(file) == 0 && written;
+		}
+	};
+}
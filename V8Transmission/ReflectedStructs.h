@@ -0,0 +1,275 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+///	The MIT License (MIT)
+///
+///	Copyright (c) 2014 Gregory Hlavac
+///
+///	Permission is hereby granted, free of charge, to any person obtaining a copy
+///	of this software and associated documentation files (the "Software"), to deal
+///	in the Software without restriction, including without limitation the rights
+///	to use, copy, modify, merge, publish, distribute, sub-license, and/or sell
+///	copies of the Software, and to permit persons to whom the Software is
+///	furnished to do so, subject to the following conditions:
+///
+///	The above copyright notice and this permission notice shall be included in
+///	all copies or substantial portions of the Software.
+///
+///	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+///	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+///	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+///	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+///	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+///	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+///	THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <v8.h>
+
+#include <memory>
+#include <utility>
+#include <type_traits>
+
+#include "Common.h"
+#include "TypeConversion.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// <summary>
+/// 	Describes a plain struct's fields to V8Transmission, which then generates its ShiftJS and
+/// 	ShiftNative. Use it at global scope, after the struct has been declared.
+/// 	
+/// 	Example
+/// 	
+/// 	struct Point { double x; double y; };
+/// 	
+/// 	V8T_REFLECT_STRUCT(Point,
+/// 		V8T_FIELD(x)
+/// 		V8T_FIELD(y))
+/// 	
+/// 	Every converted Point is created from one cached ObjectTemplate with x and y already declared,
+/// 	so all of them share a single hidden class on the JS side.
+/// </summary>
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#define V8T_REFLECT_STRUCT(StructType, Fields)																\
+	V8T_DESCRIBE_FIELDS(StructType, Fields)																	\
+																											\
+	namespace V8Transmission																				\
+	{																										\
+		namespace TypeConversion																			\
+		{																									\
+			template <> struct ShiftJS<StructType> : Internal::ShiftJS_Reflected<StructType> {};			\
+			template <> struct ShiftNative<StructType> : Internal::ShiftNative_Reflected<StructType> {};	\
+		}																									\
+	}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// <summary>
+/// 	Only describes a type's fields (StructFields<T>) without touching its ShiftJS/ShiftNative,
+/// 	for ClassGear bound types that still want to be written by the native JSON serializer.
+/// </summary>
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#define V8T_DESCRIBE_FIELDS(StructType, Fields)																\
+	namespace V8Transmission																				\
+	{																										\
+		template <>																							\
+		struct StructFields<StructType>																		\
+		{																									\
+			typedef StructType Type;																		\
+																											\
+			template <typename Visitor>																		\
+			static void Visit(Visitor& visitor)																\
+			{																								\
+				Fields																						\
+			}																								\
+		};																									\
+	}
+
+/** One field inside V8T_REFLECT_STRUCT, it is exposed to javascript under the member's own name. */
+#define V8T_FIELD(Member) visitor(#Member, &Type::Member);
+
+/** One field inside V8T_REFLECT_STRUCT, exposed to javascript under a different name. */
+#define V8T_FIELD_AS(Member, JSName) visitor(JSName, &Type::Member);
+
+namespace V8Transmission
+{
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	/// <summary>
+	/// 	The field list of a reflected struct, specialized by V8T_REFLECT_STRUCT. Visit calls the
+	/// 	visitor with the JS name and the member pointer of each field, in declaration order.
+	/// </summary>
+	///
+	/// <typeparam name="T">	Generic type parameter. </typeparam>
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	template <typename T>
+	struct StructFields;
+
+	namespace TypeConversion
+	{
+#if !defined(DOXYGEN)
+		namespace Internal
+		{
+			////////////////////////////////////////////////////////////////////////////////////////////////////
+			/// <summary>
+			/// 	The per-isolate shape of a reflected struct, the object template with every field declared
+			/// 	up front and the internalized field names used to fill it.
+			/// </summary>
+			////////////////////////////////////////////////////////////////////////////////////////////////////
+			template <typename T>
+			struct ReflectedShape
+			{
+				v8::Persistent<v8::ObjectTemplate>				Template;
+				std::unique_ptr<v8::Persistent<v8::String>[]>	Names;
+				size_t										Count;
+
+				ReflectedShape() : Count(0) {}
+
+				~ReflectedShape()
+				{
+					Template.Reset();
+
+					for (size_t i = 0; i < Count; i++)
+						Names[i].Reset();
+				}
+
+				static ReflectedShape& Get(v8::Isolate* iso)
+				{
+					ReflectedShape& shape = IsolateData::Get(iso).Slot<ReflectedShape>();
+
+					if (shape.Template.IsEmpty())
+						shape.Build(iso);
+
+					return shape;
+				}
+
+			private:
+				struct Counter
+				{
+					size_t count;
+
+					template <typename M>
+					void operator()(const char*, M T::*) { count++; }
+				};
+
+				struct Declarer
+				{
+					v8::Isolate*				iso;
+					ReflectedShape*				shape;
+					v8::Local<v8::ObjectTemplate>	tmpl;
+					size_t						index;
+
+					template <typename M>
+					void operator()(const char* name, M T::*)
+					{
+						v8::Local<v8::String> key = v8::String::NewFromUtf8(iso, name, v8::String::kInternalizedString);
+
+						shape->Names[index++].Reset(iso, key);
+						tmpl->Set(key, v8::Undefined(iso));
+					}
+				};
+
+				void Build(v8::Isolate* iso)
+				{
+					Counter counter = { 0 };
+					StructFields<T>::Visit(counter);
+
+					Count = counter.count;
+					Names.reset(new v8::Persistent<v8::String>[Count]);
+
+					v8::Local<v8::ObjectTemplate> tmpl = v8::ObjectTemplate::New(iso);
+
+					Declarer declarer = { iso, this, tmpl, 0 };
+					StructFields<T>::Visit(declarer);
+
+					Template.Reset(iso, tmpl);
+				}
+			};
+
+			template <typename T>
+			struct ShiftJS_Reflected
+			{
+				ValueHandle operator()(v8::Isolate* iso, const T& v) const
+				{
+					return Fill<const T&>(iso, v);
+				}
+
+				/** Fields of a struct nobody needs anymore are moved into their own conversions. */
+				ValueHandle operator()(v8::Isolate* iso, T&& v) const
+				{
+					return Fill<T&&>(iso, v);
+				}
+
+			private:
+				template <typename Ref>
+				struct Filler
+				{
+					v8::Isolate*			iso;
+					ReflectedShape<T>*		shape;
+					v8::Local<v8::Object>		obj;
+					typename std::remove_reference<Ref>::type* src;
+					size_t					index;
+
+					template <typename M>
+					void operator()(const char*, M T::* member)
+					{
+						typedef typename std::conditional<std::is_const<typename std::remove_reference<Ref>::type>::value, const M&, M&&>::type Forwarded;
+
+						v8::Local<v8::String> key = v8::Local<v8::String>::New(iso, shape->Names[index++]);
+
+						obj->Set(key, ConvertToJS(iso, static_cast<Forwarded>(src->*member)));
+					}
+				};
+
+				template <typename Ref>
+				static ValueHandle Fill(v8::Isolate* iso, typename std::remove_reference<Ref>::type& v)
+				{
+					ReflectedShape<T>& shape = ReflectedShape<T>::Get(iso);
+
+					v8::Local<v8::Object> obj = v8::Local<v8::ObjectTemplate>::New(iso, shape.Template)->NewInstance();
+
+					// Every property already exists on the instance, so these only overwrite values and the
+					// object keeps the template's hidden class.
+					Filler<Ref> filler = { iso, &shape, obj, &v, 0 };
+					StructFields<T>::Visit(filler);
+
+					return obj;
+				}
+			};
+
+			template <typename T>
+			struct ShiftNative_Reflected
+			{
+				T operator()(v8::Isolate* iso, const v8::Handle<v8::Value>& val) const
+				{
+					T result = T();
+
+					if (!val->IsObject())
+						return result;
+
+					Reader reader = { iso, &ReflectedShape<T>::Get(iso), val->ToObject(), &result, 0 };
+					StructFields<T>::Visit(reader);
+
+					return result;
+				}
+
+			private:
+				struct Reader
+				{
+					v8::Isolate*			iso;
+					ReflectedShape<T>*		shape;
+					v8::Local<v8::Object>		obj;
+					T*						dst;
+					size_t					index;
+
+					template <typename M>
+					void operator()(const char*, M T::* member)
+					{
+						v8::Local<v8::Value> value = obj->Get(v8::Local<v8::String>::New(iso, shape->Names[index++]));
+
+						if (!value->IsUndefined())
+							dst->*member = ConvertFromJS<M>(iso, value);
+					}
+				};
+			};
+		}
+#endif
+	}
+}
@@ -0,0 +1,509 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+///	The MIT License (MIT)
+///
+///	Copyright (c) 2014 Gregory Hlavac
+///
+///	Permission is hereby granted, free of charge, to any person obtaining a copy
+///	of this software and associated documentation files (the "Software"), to deal
+///	in the Software without restriction, including without limitation the rights
+///	to use, copy, modify, merge, publish, distribute, sub-license, and/or sell
+///	copies of the Software, and to permit persons to whom the Software is
+///	furnished to do so, subject to the following conditions:
+///
+///	The above copyright notice and this permission notice shall be included in
+///	all copies or substantial portions of the Software.
+///
+///	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+///	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+///	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+///	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+///	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+///	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+///	THE SOFTWARE.
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <v8.h>
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <condition_variable>
+
+#include "Common.h"
+#include "GCPauses.h"
+#include "NativeJSON.h"
+
+// Trace points compile to a relaxed load and a branch while tracing is off, define this as 0 to
+// compile them out altogether.
+#if !defined(V8T_ENABLE_TRACING)
+#	define V8T_ENABLE_TRACING 1
+#endif
+
+#define V8T_TRACE_CONCAT_(A, B) A##B
+#define V8T_TRACE_CONCAT(A, B) V8T_TRACE_CONCAT_(A, B)
+
+#if V8T_ENABLE_TRACING
+/** Records the rest of the enclosing block as one complete event, name must be a string literal. */
+#	define V8T_TRACE_SCOPE(category, name) \
+		::V8Transmission::TraceScope V8T_TRACE_CONCAT(v8tTraceScope_, __LINE__)(category, name)
+
+/** Times a gear call as a "gears" event, with the bound function's name as its detail. */
+#	if !V8T_V8_AT_LEAST(6, 0)
+#		define V8T_TRACE_GEAR(args, name) \
+			::V8Transmission::TraceScope v8tGearTrace(::V8Transmission::Trace::Gears, name); \
+			if (v8tGearTrace.Active()) v8tGearTrace.Detail(*v8::String::Utf8Value((args).Callee()->GetName()))
+#	else
+// FunctionCallbackInfo::Callee is gone, the event only carries the gear kind.
+#		define V8T_TRACE_GEAR(args, name) \
+			::V8Transmission::TraceScope v8tGearTrace(::V8Transmission::Trace::Gears, name)
+#	endif
+#else
+#	define V8T_TRACE_SCOPE(category, name)
+#	define V8T_TRACE_GEAR(args, name)
+#endif
+
+namespace V8Transmission
+{
+	namespace Trace
+	{
+		/** What a trace point belongs to, Tracer::SetCategories filters on these. */
+		enum Category : uint32_t
+		{
+			Gears	= 1 << 0,
+			Compile	= 1 << 1,
+			Execute	= 1 << 2,
+			IO		= 1 << 3,
+			GC		= 1 << 4,
+			Host	= 1 << 5,
+			All		= 0xFFFFFFFFu
+		};
+
+		inline const char* CategoryName(uint32_t category)
+		{
+			switch (category)
+			{
+			case Gears:		return "gears";
+			case Compile:	return "compile";
+			case Execute:	return "execute";
+			case IO:		return "io";
+			case GC:		return "gc";
+			case Host:		return "host";
+			default:		return "other";
+			}
+		}
+
+		/** Parses a comma separated list such as "gears,gc", or "all". */
+		inline uint32_t ParseCategories(const char* list)
+		{
+			static const uint32_t known[] = { Gears, Compile, Execute, IO, GC, Host };
+			uint32_t mask = 0;
+
+			while (list != nullptr && *list != '\0')
+			{
+				const char* end = strchr(list, ',');
+				size_t length = end != nullptr ? static_cast<size_t>(end - list) : strlen(list);
+
+				if (length == 3 && strncmp(list, "all", 3) == 0)
+					mask = All;
+
+				for (size_t i = 0; i < sizeof(known) / sizeof(known[0]); i++)
+				{
+					const char* name = CategoryName(known[i]);
+
+					if (strlen(name) == length && strncmp(list, name, length) == 0)
+						mask |= known[i];
+				}
+
+				list = end != nullptr ? end + 1 : nullptr;
+			}
+
+			return mask;
+		}
+	}
+
+	namespace Internal
+	{
+		struct TraceEvent
+		{
+			const char*	name;
+			uint32_t	category;
+			char		phase;
+			uint64_t	timestamp;
+			uint64_t	duration;
+			char		detail[40];
+		};
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		/// <summary>
+		/// 	One thread's events, a single producer single consumer ring. The owning thread only ever
+		/// 	moves head and the flusher only ever moves tail, so neither side takes a lock. A full ring
+		/// 	drops the event and counts it rather than making the traced thread wait.
+		/// </summary>
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		struct TraceBuffer
+		{
+			enum { Capacity = 4096 };
+
+			TraceEvent				events[Capacity];
+			std::atomic<uint32_t>	head;
+			std::atomic<uint32_t>	tail;
+			std::atomic<uint64_t>	dropped;
+			uint32_t				thread;
+
+			explicit TraceBuffer(uint32_t thread) : head(0), tail(0), dropped(0), thread(thread) {}
+
+			void Push(const TraceEvent& event)
+			{
+				uint32_t h = head.load(std::memory_order_relaxed);
+
+				if (h - tail.load(std::memory_order_acquire) >= Capacity)
+				{
+					dropped.fetch_add(1, std::memory_order_relaxed);
+					return;
+				}
+
+				events[h & (Capacity - 1)] = event;
+				head.store(h + 1, std::memory_order_release);
+			}
+
+			template <typename Consumer>
+			void Drain(Consumer consume)
+			{
+				uint32_t t = tail.load(std::memory_order_relaxed);
+				uint32_t h = head.load(std::memory_order_acquire);
+
+				for (; t != h; t++)
+					consume(events[t & (Capacity - 1)]);
+
+				tail.store(t, std::memory_order_release);
+			}
+		};
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	/// <summary>
+	/// 	Writes Chrome trace event JSON, loadable in Perfetto or chrome://tracing.
+	/// 	
+	/// 	Trace points push into a ring owned by their thread and a background thread drains all of
+	/// 	them into the file every FlushInterval, so recording an event never does IO or takes a lock.
+	/// 	Which categories are recorded can be changed at any time, with zero pausing the trace
+	/// 	without closing it.
+	/// 	
+	/// 	Tracer::Shared().Start("trace.json", Trace::ParseCategories("gears,gc"));
+	/// 	...
+	/// 	Tracer::Shared().Stop();
+	/// </summary>
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	class Tracer
+	{
+	public:
+		static const int FlushInterval = 100;
+
+		static Tracer& Shared()
+		{
+			static Tracer* tracer = new Tracer;
+
+			return *tracer;
+		}
+
+		/** The one check every trace point makes first. */
+		static bool Enabled(uint32_t category)
+		{
+			return (Shared().categories.load(std::memory_order_relaxed) & category) != 0;
+		}
+
+		static uint64_t NowMicros()
+		{
+			return Timing::NowMicros();
+		}
+
+		/** Opens the trace file and starts recording the given categories, false if it can't be opened. */
+		bool Start(const char* path, uint32_t categoryMask)
+		{
+			std::lock_guard<std::mutex> guard(lock);
+
+			if (file != nullptr)
+				return false;
+
+			file = fopen(path, "wb");
+
+			if (file == nullptr)
+				return false;
+
+			fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", file);
+			written = 0;
+			stopping = false;
+			flusher = std::thread([this]() { FlushLoop(); });
+
+			categories.store(categoryMask, std::memory_order_relaxed);
+
+			return true;
+		}
+
+		/** Stops recording, writes out whatever is still buffered and closes the file. */
+		void Stop()
+		{
+			categories.store(0, std::memory_order_relaxed);
+
+			{
+				std::lock_guard<std::mutex> guard(lock);
+
+				if (file == nullptr)
+					return;
+
+				stopping = true;
+			}
+
+			wake.notify_one();
+			flusher.join();
+
+			std::lock_guard<std::mutex> guard(lock);
+
+			FlushLocked();
+			fputs("]}\n", file);
+			fclose(file);
+			file = nullptr;
+		}
+
+		/** Changes what is recorded while the trace is open, zero pauses it. */
+		void SetCategories(uint32_t categoryMask)
+		{
+			std::lock_guard<std::mutex> guard(lock);
+
+			if (file != nullptr)
+				categories.store(categoryMask, std::memory_order_relaxed);
+		}
+
+		uint32_t Categories() const
+		{
+			return categories.load(std::memory_order_relaxed);
+		}
+
+		/** Records an event that started at start and lasted duration microseconds ("X"). */
+		void Complete(uint32_t category, const char* name, uint64_t start, uint64_t duration, const char* detail = nullptr)
+		{
+			Record(category, 'X', name, start, duration, detail);
+		}
+
+		/** Records a point in time ("i"). */
+		void Instant(uint32_t category, const char* name, const char* detail = nullptr)
+		{
+			Record(category, 'i', name, NowMicros(), 0, detail);
+		}
+
+		/** Events lost to full rings so far, over all threads. */
+		uint64_t Dropped()
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			uint64_t total = 0;
+
+			for (size_t i = 0; i < buffers.size(); i++)
+				total += buffers[i]->dropped.load(std::memory_order_relaxed);
+
+			return total;
+		}
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		/// <summary>
+		/// 	Listens to the isolate's GCPauses, recording every collection as a "gc" event on the
+		/// 	isolate's thread, named after its type.
+		/// </summary>
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		static void InstallGCHooks(v8::Isolate* iso)
+		{
+			GCHook& hook = IsolateData::Get(iso).Slot<GCHook>();
+
+			if (hook.id == 0)
+				hook.id = GCPauses::ForIsolate(iso).Add(iso, OnGC);
+		}
+
+		static void RemoveGCHooks(v8::Isolate* iso)
+		{
+			GCHook& hook = IsolateData::Get(iso).Slot<GCHook>();
+
+			if (hook.id != 0)
+				GCPauses::ForIsolate(iso).Remove(iso, hook.id);
+
+			hook.id = 0;
+		}
+
+	private:
+		std::atomic<uint32_t>			categories;
+		std::mutex						lock;
+		std::condition_variable			wake;
+		std::thread						flusher;
+		bool							stopping;
+		FILE*							file;
+		uint64_t						written;
+		std::vector<std::unique_ptr<Internal::TraceBuffer> >	buffers;
+
+		Tracer() : categories(0), stopping(false), file(nullptr), written(0) {}
+
+		/** The calling thread's ring, made on its first event and kept for the life of the process. */
+		Internal::TraceBuffer& ThreadBuffer()
+		{
+			static thread_local Internal::TraceBuffer* buffer = nullptr;
+
+			if (buffer == nullptr)
+			{
+				std::lock_guard<std::mutex> guard(lock);
+
+				buffers.push_back(std::unique_ptr<Internal::TraceBuffer>(new Internal::TraceBuffer(static_cast<uint32_t>(buffers.size() + 1))));
+				buffer = buffers.back().get();
+			}
+
+			return *buffer;
+		}
+
+		void Record(uint32_t category, char phase, const char* name, uint64_t start, uint64_t duration, const char* detail)
+		{
+			Internal::TraceEvent event;
+			event.name = name;
+			event.category = category;
+			event.phase = phase;
+			event.timestamp = start;
+			event.duration = duration;
+			event.detail[0] = '\0';
+
+			if (detail != nullptr)
+			{
+				strncpy(event.detail, detail, sizeof(event.detail) - 1);
+				event.detail[sizeof(event.detail) - 1] = '\0';
+			}
+
+			ThreadBuffer().Push(event);
+		}
+
+		void FlushLoop()
+		{
+			std::unique_lock<std::mutex> guard(lock);
+
+			while (!stopping)
+			{
+				wake.wait_for(guard, std::chrono::milliseconds(FlushInterval));
+				FlushLocked();
+			}
+		}
+
+		/** Drains every ring into the file, with lock held. */
+		void FlushLocked()
+		{
+			JsonWriter json(64 * 1024);
+
+			for (size_t i = 0; i < buffers.size(); i++)
+			{
+				uint32_t thread = buffers[i]->thread;
+
+				buffers[i]->Drain([&json, thread](const Internal::TraceEvent& event) {
+					char phase[2] = { event.phase, '\0' };
+
+					json.BeginObject();
+					json.Key("name");	json.String(event.name, strlen(event.name));
+					json.Key("cat");	json.String(Trace::CategoryName(event.category), strlen(Trace::CategoryName(event.category)));
+					json.Key("ph");		json.String(phase, 1);
+					json.Key("ts");		json.Unsigned(event.timestamp);
+
+					if (event.phase == 'X')
+					{
+						json.Key("dur");	json.Unsigned(event.duration);
+					}
+					else
+					{
+						json.Key("s");		json.String("t", 1);
+					}
+
+					json.Key("pid");	json.Integer(1);
+					json.Key("tid");	json.Unsigned(thread);
+
+					if (event.detail[0] != '\0')
+					{
+						json.Key("args");
+						json.BeginObject();
+						json.Key("detail");	json.String(event.detail, strlen(event.detail));
+						json.EndObject();
+					}
+
+					json.EndObject();
+				});
+			}
+
+			if (json.Buffer().empty())
+				return;
+
+			if (written++ != 0)
+				fputc(',', file);
+
+			fwrite(json.Buffer().data(), 1, json.Buffer().size(), file);
+			fflush(file);
+		}
+
+		/** The isolate's GCPauses listener id, 0 while not installed. */
+		struct GCHook
+		{
+			int id;
+
+			GCHook() : id(0) {}
+		};
+
+		static void OnGC(v8::Isolate* iso, v8::GCType type, uint64_t started, double pauseMs)
+		{
+			if (!Enabled(Trace::GC))
+				return;
+
+			Shared().Complete(Trace::GC, type == v8::kGCTypeScavenge ? "Scavenge" : "MarkSweepCompact", started, static_cast<uint64_t>(pauseMs * 1000.0));
+		}
+	};
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	/// <summary>
+	/// 	Times the enclosing block as one complete event, see V8T_TRACE_SCOPE. Checks the category
+	/// 	once on entry, a block that started while its category was off records nothing.
+	/// </summary>
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	class TraceScope
+	{
+	public:
+		TraceScope(uint32_t category, const char* name) : category(category), name(name), start(0)
+		{
+			detail[0] = '\0';
+
+			if (Tracer::Enabled(category))
+				start = Tracer::NowMicros();
+		}
+
+		~TraceScope()
+		{
+			if (start != 0)
+				Tracer::Shared().Complete(category, name, start, Tracer::NowMicros() - start, detail[0] != '\0' ? detail : nullptr);
+		}
+
+		bool Active() const { return start != 0; }
+
+		/** Attaches a short string to the event, shown under its args. Only copied when recording. */
+		void Detail(const char* text)
+		{
+			if (start != 0 && text != nullptr)
+			{
+				strncpy(detail, text, sizeof(detail) - 1);
+				detail[sizeof(detail) - 1] = '\0';
+			}
+		}
+
+	private:
+		TraceScope(const TraceScope&);
+		TraceScope& operator=(const TraceScope&);
+
+		uint32_t	category;
+		const char*	name;
+		uint64_t	start;
+		char		detail[40];
+	};
+}
@@ -28,6 +28,8 @@
 #include <stdint.h>
 #include <string>
 #include <vector>
+#include <utility>
+#include <type_traits>
 
 #include "Common.h"
 
@@ -39,7 +41,7 @@ namespace V8Transmission
 		struct ShiftJS
 		{
 			template <typename X>
-			ValueHandle operator()(v8::Isolate*, X const &) const;
+			ValueHandle operator()(v8::Isolate*, X&&) const;
 		};
 
 		template <typename NativeType>
@@ -93,6 +95,58 @@ namespace V8Transmission
 					return v8::Number::New(iso, static_cast<double>(v));
 				}
 			};
+
+			template <typename IntegralType>
+			struct ShiftNative_Integer_Small
+			{
+				IntegralType operator()(v8::Isolate* iso, const v8::Handle<v8::Value>& val) const
+				{
+					return static_cast<IntegralType>(val->Int32Value());
+				}
+			};
+
+			template <typename IntegralType>
+			struct ShiftNative_Unsigned_Integer_Small
+			{
+				IntegralType operator()(v8::Isolate* iso, const v8::Handle<v8::Value>& val) const
+				{
+					return static_cast<IntegralType>(val->Uint32Value());
+				}
+			};
+
+			template <typename IntegralType>
+			struct ShiftNative_Integer_Large
+			{
+				/** Goes through a double, so only integers up to 2^53 come back exact. */
+				IntegralType operator()(v8::Isolate* iso, const v8::Handle<v8::Value>& val) const
+				{
+					return static_cast<IntegralType>(val->NumberValue());
+				}
+			};
+
+			inline bool IsAscii(const std::string& str)
+			{
+				for (size_t i = 0; i < str.size(); i++)
+				{
+					if (static_cast<unsigned char>(str[i]) > 0x7F)
+						return false;
+				}
+
+				return true;
+			}
+
+			/** Owns a std::string that was moved into V8, deleted by V8 once the JS string is collected. */
+			class MovedAsciiStringResource : public v8::String::ExternalAsciiStringResource
+			{
+			public:
+				explicit MovedAsciiStringResource(std::string&& str) : str(std::move(str)) {}
+
+				const char* data() const { return str.data(); }
+				size_t length() const { return str.size(); }
+
+			private:
+				std::string str;
+			};
 		}
 #endif
 
@@ -25,21 +25,42 @@
 
 #include <v8.h>
 
+#include <utility>
+#include <type_traits>
+
 #include "Common.h"
 #include "TypeConversion.h"
 #include "NativeShifts.h"
+#include "ReflectedStructs.h"
+#include "NativeJSON.h"
+#include "GCPauses.h"
+#include "Tracing.h"
+#include "Profiling.h"
 
 #include "ClassGears.h"
 #include "ClassOptions.h"
+#include "ConstructorGears.h"
+#include "OwnershipPolicies.h"
 #include "FunctionGears.h"
 #include "VariableGears.h"
+#include "ClassRegistry.h"
+#include "Census.h"
+#include "ContextPool.h"
+#include "Deadlines.h"
+#include "AsyncGears.h"
+#include "CoroutineGears.h"
+#include "CallbackGears.h"
+#include "EventChannels.h"
+#include "IterableGears.h"
+#include "ArrayViewGears.h"
+#include "IsolateTransfer.h"
 
 namespace V8Transmission
 {
 	template <typename T>
-	v8::Handle<v8::Value> ConvertToJS(v8::Isolate* iso,T v)
+	v8::Handle<v8::Value> ConvertToJS(v8::Isolate* iso, T&& v)
 	{
-		return TypeConversion::ShiftJS<T>()(iso, v);
+		return TypeConversion::ShiftJS<typename std::decay<T>::type>()(iso, std::forward<T>(v));
 	}
 
 	template <typename NT>
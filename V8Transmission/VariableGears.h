@@ -25,6 +25,8 @@
 
 #include <v8.h>
 
+#include <atomic>
+
 using v8::Local;
 using v8::String;
 using v8::ObjectTemplate;
@@ -36,6 +38,17 @@ namespace V8Transmission
 	////////////////////////////////////////////////////////////////////////////////////////////////////
 	/// <summary>
 	/// 	A static variable gear.
+	/// 	
+	/// 	BindConstant installs the current value as a plain read-only data property on the template,
+	/// 	so reads never call back into C++ and the optimizing compiler can treat it as a constant; use
+	/// 	it for values that never change after startup (limits, enum values and so on). Templates can
+	/// 	only hold primitives, so this is for types that convert to numbers, booleans or strings.
+	/// 	
+	/// 	BindRO and BindRW keep the accessor but cache the converted value per isolate, reconverting
+	/// 	only when the version has moved on. Writes from javascript bump it automatically, native
+	/// 	code that writes the variable directly has to call Changed() (or write through Set). Only
+	/// 	primitives are cached, an object would be one instance shared by every context in the
+	/// 	isolate (pooled tenant contexts included), so those are converted afresh on every read.
 	/// </summary>
 	///
 	/// <typeparam name="ValueType">				 	Type of the value type. </typeparam>
@@ -46,11 +59,96 @@ namespace V8Transmission
 	{
 		static void Getter(v8::Local<v8::String> property, const v8::PropertyCallbackInfo<v8::Value>& info)
 		{
-			info.GetReturnValue().Set(ConvertToJS<ValueType>(info.GetIsolate(), (*StaticVariable)));
+			info.GetReturnValue().Set(ConvertToJS(info.GetIsolate(), (*StaticVariable)));
 		}
 		static void Setter(v8::Local<v8::String> property, v8::Local<v8::Value> value, const v8::PropertyCallbackInfo<void>& info)
 		{
 			(*StaticVariable) = ConvertFromJS<ValueType>(info.GetIsolate(), value);
+			Changed();
+		}
+
+		/** Getter that hands out the cached conversion while the version is unchanged. */
+		static void CachedGetter(v8::Local<v8::String> property, const v8::PropertyCallbackInfo<v8::Value>& info)
+		{
+			Isolate* iso = info.GetIsolate();
+			Cache& cache = IsolateData::Get(iso).Slot<Cache>();
+			unsigned current = Version().load(std::memory_order_acquire);
+
+			if (cache.version == current && !cache.value.IsEmpty())
+			{
+				info.GetReturnValue().Set(cache.value);
+				return;
+			}
+
+			v8::Handle<v8::Value> value = ConvertToJS(iso, (*StaticVariable));
+
+			if (value->IsObject())
+			{
+				// Mutable and per context, see the class comment.
+				cache.value.Reset();
+			}
+			else
+			{
+				cache.value.Reset(iso, value);
+				cache.version = current;
+			}
+
+			info.GetReturnValue().Set(value);
+		}
+
+		/** Invalidates the cached conversion in every isolate, call it after writing the variable natively. */
+		static void Changed()
+		{
+			Version().fetch_add(1, std::memory_order_release);
+		}
+
+		/** Writes the variable and invalidates the cache in one go. */
+		static void Set(const ValueType& value)
+		{
+			(*StaticVariable) = value;
+			Changed();
+		}
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		/// <summary>
+		/// 	Installs the variable's current value as a read-only, non-deletable data property. Later
+		/// 	native writes are not seen by javascript.
+		/// </summary>
+		///
+		/// <param name="iso"> 	[in,out] If non-null, the ISO. </param>
+		/// <param name="tmpl">	The template to install it on (global, constructor or prototype). </param>
+		/// <param name="name">	The property name. </param>
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		static void BindConstant(Isolate* iso, Local<v8::Template> tmpl, const char* name)
+		{
+			tmpl->Set(String::NewFromUtf8(iso, name), ConvertToJS(iso, (*StaticVariable)), static_cast<v8::PropertyAttribute>(v8::ReadOnly | v8::DontDelete));
+		}
+
+		static void BindRW(Isolate* iso, Local<ObjectTemplate> tmpl, const char* name)
+		{
+			tmpl->SetAccessor(String::NewFromUtf8(iso, name), CachedGetter, Setter);
+		}
+
+		static void BindRO(Isolate* iso, Local<ObjectTemplate> tmpl, const char* name)
+		{
+			tmpl->SetAccessor(String::NewFromUtf8(iso, name), CachedGetter, nullptr, v8::Handle<v8::Value>(), v8::DEFAULT, v8::ReadOnly);
+		}
+
+	private:
+		struct Cache
+		{
+			unsigned					version;
+			v8::Persistent<v8::Value>	value;
+
+			Cache() : version(0) {}
+			~Cache() { value.Reset(); }
+		};
+
+		static std::atomic<unsigned>& Version()
+		{
+			static std::atomic<unsigned> version(1);
+
+			return version;
 		}
 	};
 
@@ -71,25 +169,39 @@ namespace V8Transmission
 
 		static void Getter(v8::Local<v8::String> property, const v8::PropertyCallbackInfo<v8::Value>& info)
 		{
-			ThisClass* var = CG::Unwrap(info.GetIsolate(), info.Holder());
-			info.GetReturnValue().Set(ConvertToJS<VariableType>(info.GetIsolate(), (var->*MemberVariable)));
+			ThisClass* var = CG::UnwrapUnchecked(info.GetIsolate(), info.This());
+
+			if (var == nullptr)
+			{
+				CG::ThrowReleased(info.GetIsolate());
+				return;
+			}
+
+			info.GetReturnValue().Set(ConvertToJS(info.GetIsolate(), (var->*MemberVariable)));
 		}
 		static void Setter(v8::Local<v8::String> property, v8::Local<v8::Value> value, const v8::PropertyCallbackInfo<void>& info)
 		{
-			ThisClass* var = CG::Unwrap(info.GetIsolate(), info.Holder());
+			ThisClass* var = CG::UnwrapUnchecked(info.GetIsolate(), info.This());
+
+			if (var == nullptr)
+			{
+				CG::ThrowReleased(info.GetIsolate());
+				return;
+			}
+
 			(var->*MemberVariable) = ConvertFromJS<VariableType>(info.GetIsolate(), value);
 		}
 
 		static void BindRW(Isolate* iso, const char* name)
 		{
-			Local<ObjectTemplate> protoTmpl = Local<ObjectTemplate>::New(iso, ClassGear<ThisClass>::PrototypeTemplate);
-			protoTmpl->SetAccessor(String::NewFromUtf8(iso, name), Getter, Setter);
+			Local<ObjectTemplate> protoTmpl = ClassGear<ThisClass>::PrototypeTemplate(iso);
+			protoTmpl->SetAccessor(String::NewFromUtf8(iso, name), Getter, Setter, v8::Handle<v8::Value>(), v8::DEFAULT, v8::None, CG::ReceiverAccessorSignature(iso));
 		}
 
 		static void BindRO(Isolate* iso, const char* name)
 		{
-			Local<ObjectTemplate> protoTmpl = Local<ObjectTemplate>::New(iso, ClassGear<ThisClass>::PrototypeTemplate);
-			protoTmpl->SetAccessor(String::NewFromUtf8(iso, name), Getter);
+			Local<ObjectTemplate> protoTmpl = ClassGear<ThisClass>::PrototypeTemplate(iso);
+			protoTmpl->SetAccessor(String::NewFromUtf8(iso, name), Getter, nullptr, v8::Handle<v8::Value>(), v8::DEFAULT, v8::None, CG::ReceiverAccessorSignature(iso));
 		}
 	};
 }
\ No newline at end of file